@@ -23,48 +23,281 @@
 #include <stdlib.h>
 #include <math.h>
 #include "q_emul.h"
-
-#define TAG_COMMENT '#'
-#define TAG_OPEN '{'
-#define TAG_CLOSE '}'
-#define TAG_LOOP 'L'
-
-#define TAG_EXEC '!'
-#define TAG_ORACLE 'O'
-#define TAG_FUNCTION 'F'
-#define TAG_WRITE 'W'
-#define TAG_READ 'R'
+#include "q_circuit.h"
 
 void usage(char * Cmd)
 {
-	fprintf(stderr,"Usage: %s <numQubits> <FileName>\n", Cmd);
+	fprintf(stderr,"Usage: %s <numQubits> <FileName> [shots] [-o <CompiledName>]\n", Cmd);
+	fprintf(stderr,"       FileName is a circuit, or one saved with -o\n");
+	fprintf(stderr,"       QUIC_SEED in the environment seeds the m gates and the shots\n");
 	return;
 }
 
+// with shots, every m column splits the run into one branch per outcome
+// drawn, each carrying its share of the shots, and the end of each branch
+// draws its shots over all the qubits into histogram
+
+typedef struct _QRun
+{
+	int loop;
+	unsigned long shots;
+	QHash * histogram;
+	unsigned long * branches;
+	int * width;                // numQubits at the end
+} QRun;
+
+static int compareOutcome(const void * a, const void * b)
+{
+	unsigned long x = *(const unsigned long *) a;
+	unsigned long y = *(const unsigned long *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void printOutcome(int numQubits, unsigned long qubitMask, unsigned long value, unsigned long shots)
+{
+	char binStr[MAX_QUBITS+1];
+	int j, k;
+
+	for (j = 0, k = 0; j < numQubits; j++)
+	{
+		if (qubitMask & (1UL << (numQubits - 1 - j)))
+			binStr[k++] = (value & (1UL << (numQubits - 1 - j))) ? '1' : '0';
+	}
+	binStr[k] = 0;
+	fprintf(stdout,"Sample [%s] Shots[%lu]\n",binStr,shots);
+}
+
+// the outcomes of shots draws on qubitMask, sorted so equal ones are together.
+// the entries are weighed as the m gate weighs them, so the shots follow the
+// outcomes of as many single runs
+
+static unsigned long * drawSamples(QState * qList, unsigned long qubitMask, unsigned long shots)
+{
+	unsigned long * out = (unsigned long *) malloc(shots * sizeof(unsigned long));
+
+	if (!out)
+	{
+		fprintf(stderr,"error: unable to malloc samples\n");
+		exit(-1);
+	}
+	if (qEmul_SampleMeasure(qList,qubitMask,shots,out) != 0)
+	{
+		free(out);
+		return NULL;
+	}
+	qsort(out,shots,sizeof(unsigned long),compareOutcome);
+	return out;
+}
+
+// prints how often each outcome of the qubits in qubitMask came up in shots draws
+
+static void printSamples(int numQubits, unsigned long qubitMask, unsigned long shots, QState * qList)
+{
+	unsigned long * out;
+	unsigned long i, start;
+
+	if ((shots == 0) || (qubitMask == 0))
+		return;
+	if ((out = drawSamples(qList,qubitMask,shots)) != NULL)
+	{
+		for (start = 0; start < shots; start = i)
+		{
+			for (i = start; (i < shots) && (out[i] == out[start]); i++)
+				;
+			printOutcome(numQubits,qubitMask,out[start],i - start);
+		}
+		free(out);
+	}
+}
+
+// runs the column of op, which is gate or gate with its m filled in
+
+static void runColumn(QOp * op, char * gate, int * numQubits, QState ** qList)
+{
+	char outString[10000];
+
+	*numQubits = qEmul_exec(*numQubits,gate,qList);
+	if (op->Print)
+	{
+		memset(outString,0,sizeof(outString));
+		sprintf(outString,"completed gate %s\n",gate);
+		qEmul_PrintList(*numQubits, *qList,outString,sizeof(outString)-strlen(outString)-1);
+		fprintf(stdout,outString);
+	}
+}
+
+static int runOps(QCircuit * qc, QRun * run, unsigned long pc, int * numQubits, QState ** qList);
+
+// a branch that ran to the end draws its shots into the histogram. gate, if
+// there is one, is run first in place of the column at pc
+
+static void runBranch(QCircuit * qc, QRun run, unsigned long pc, char * gate, int numQubits, QState ** qList)
+{
+	unsigned long * out;
+	unsigned long i;
+
+	if (gate)
+		runColumn(&(qc->Ops[pc++]),gate,&numQubits,qList);
+	if (runOps(qc,&run,pc,&numQubits,qList))
+		return;
+	(*run.branches)++;
+	*run.width = numQubits;
+	if ((out = drawSamples(*qList,0xFFFFFFFFFFFFFFFF >> (64 - numQubits),run.shots)) != NULL)
+	{
+		for (i = 0; i < run.shots; i++)
+			qState_HashAdd(run.histogram,out[i],1.0);
+		free(out);
+	}
+}
+
+// the column at pc has m gates. the shots are split by drawing the measured
+// qubits, and each outcome continues with its m replaced by 0 or 1. all but
+// the last branch work on a copy of the state
+
+static void branchMeasure(QCircuit * qc, QRun * run, unsigned long pc, int numQubits, QState ** qList)
+{
+	QOp * op = &(qc->Ops[pc]);
+	char * column = &(qc->Text[op->Data]);
+	char gate[MAX_QUBITS+1];
+	unsigned long * out;
+	unsigned long i, start;
+	QState * branchList;
+	QRun branch;
+	int j;
+
+	if ((out = drawSamples(*qList,op->Mask,run->shots)) == NULL)
+		return;
+	for (start = 0; start < run->shots; start = i)
+	{
+		for (i = start; (i < run->shots) && (out[i] == out[start]); i++)
+			;
+		memset(gate,0,sizeof(gate));
+		for (j = 0; j < numQubits; j++)
+		{
+			gate[j] = column[j];
+			if (column[j] == MEASURE)
+				gate[j] = (out[start] & (1UL << (numQubits - 1 - j))) ? MEASURE_1 : MEASURE_0;
+		}
+
+		if (i < run->shots)
+			qEmul_CopyList(*qList,&branchList);
+		else
+		{
+			branchList = *qList;
+			*qList = NULL;
+		}
+		branch = *run;
+		branch.shots = i - start;
+		runBranch(qc,branch,pc,gate,numQubits,&branchList);
+		qEmul_FreeList(branchList);
+	}
+	free(out);
+}
+
+// runs the ops from pc to the end. returns 1 if it branched, the branches
+// having finished the program
+
+static int runOps(QCircuit * qc, QRun * run, unsigned long pc, int * numQubits, QState ** qList)
+{
+	unsigned long args[MAX_PARAMS];
+	char gate[MAX_QUBITS+1];
+	char outString[10000];
+	QOp * op;
+
+	while (1)
+	{
+		op = &(qc->Ops[pc++]);
+		switch (op->Op)
+		{
+			case QOP_COLUMN:
+				if (run->shots && op->Mask)
+				{
+					branchMeasure(qc,run,pc - 1,*numQubits,qList);
+					return 1;
+				}
+				memset(gate,0,sizeof(gate));
+				memcpy(gate,&(qc->Text[op->Data]),*numQubits);
+				runColumn(op,gate,numQubits,qList);
+				break;
+			case QOP_PRINT:
+				memset(outString,0,sizeof(outString));
+				qEmul_PrintList(*numQubits, *qList,outString,sizeof(outString)-strlen(outString)-1);
+				fprintf(stdout,outString);
+				break;
+			case QOP_END:
+				return 0;
+			case QOP_LOOP:
+				run->loop = (int) op->Arg;
+				break;
+			case QOP_CLOSE:
+				if (run->loop > 1)
+				{
+					run->loop--;
+					pc = op->Arg;
+				}
+				break;
+			case QOP_ORACLE:
+				memset(args,0,sizeof(args));
+				memcpy(&args[2],&(qc->Params[op->Data]),op->Len * sizeof(unsigned long));
+				qEmul_oracleArgs(op->Arg2,OracleList[op->Arg],OraclePrepareList[op->Arg],OracleEvaluateList[op->Arg],args,qList);
+				break;
+			case QOP_FUNCTION:
+				memset(args,0,sizeof(args));
+				memcpy(args,&(qc->Params[op->Data]),op->Len * sizeof(unsigned long));
+				qEmul_functionArgs(op->Arg2,FunctionList[op->Arg],FunctionDirectList[op->Arg],args,qList);
+				break;
+			case QOP_READ:
+				qEmul_Read(*numQubits,&(qc->Text[op->Data]),qList);
+				break;
+			case QOP_WRITE:
+				qEmul_Write(*numQubits,&(qc->Text[op->Data]),*qList);
+				break;
+			case QOP_SAMPLE:
+				printSamples(*numQubits,op->Mask,op->Arg,*qList);
+				break;
+		}
+	}
+}
+
 int main(int argc, char * argv[])
 {
 	FILE * qFile;
 	int numQubits = 0;
-	int i;
-	int done = 0;
-	int loop = 0;
-	long int loopPosn;
-	char nextGate[MAX_QUBITS+1];
-	char *AlgoStr;
-	int mask = 1;
 	QState * qList = NULL;
 	float Probability = 1.0;
 	char outString[10000];
-	char algoBuf[10000];
+	QHash histogram;
+	QState * histList, * currPtr;
+	unsigned long branches = 0;
+	int width;
+	QRun run;
+	QCircuit qc;
+	char * saveName = NULL;
+	char * shotStr = NULL;
+	char * seedStr;
+	int i, ret;
 	
 	fprintf(stderr,"QuICrun version %1.2f\n",(float)qEmul_Version()/100.0);
 	fprintf(stderr,"--------------------\n");
 
-	if (argc != 3)
+	if (argc < 3)
 	{
 		usage(argv[0]);
 		return -1; 
 	}
+	for (i = 3; i < argc; i++)
+	{
+		if (!strcmp(argv[i],"-o") && (i + 1 < argc) && !saveName)
+			saveName = argv[++i];
+		else if (!shotStr)
+			shotStr = argv[i];
+		else
+		{
+			usage(argv[0]);
+			return -1;
+		}
+	}
 	numQubits = atoi(argv[1]);
 	if ((numQubits <= 0) || (numQubits > MAX_QUBITS))
 	{
@@ -72,140 +305,64 @@ int main(int argc, char * argv[])
 		return -1;
 	}
 
-	if (!(qFile = fopen(argv[2],"r")))
+	// a saved circuit is run as it is, anything else is compiled first
+	if ((ret = qCircuit_Load(argv[2],&qc)) < 0)
+		return -1;
+	if (ret > 0)
 	{
-		fprintf(stderr,"Error: Unable to open <%s> for reading\n",argv[1]);
-		return -1; 
+		if (!(qFile = fopen(argv[2],"r")))
+		{
+			fprintf(stderr,"Error: Unable to open <%s> for reading\n",argv[2]);
+			return -1; 
+		}
+		ret = qCircuit_Compile(qFile,numQubits,&qc);
+		fclose(qFile);
+		if (ret)
+			return -1;
 	}
-
-	qEmul_CreateList(&qList);
-	while (!feof(qFile) && !(done))
+	else if (qc.numQubits != numQubits)
+	{
+		fprintf(stderr,"Error: <%s> was compiled for %d qubits\n",argv[2],qc.numQubits);
+		qCircuit_Free(&qc);
+		return -1;
+	}
+	if (saveName && qCircuit_Save(&qc,saveName))
 	{
-		memset(algoBuf,0,sizeof(algoBuf));
-		fgets(algoBuf,sizeof(algoBuf)-1,qFile);
+		qCircuit_Free(&qc);
+		return -1;
+	}
 
-		AlgoStr = algoBuf;	
+	memset(&run,0,sizeof(run));
+	if (shotStr)
+	{
+		run.shots = strtoul(shotStr,NULL,10);
+		run.histogram = &histogram;
+		run.branches = &branches;
+		run.width = &width;
+		width = numQubits;
+		qState_HashInit(&histogram,0);
+	}
 
-		if (*AlgoStr == TAG_COMMENT)
-			continue;
-		else if (*AlgoStr == TAG_OPEN)
-		{
-			if (AlgoStr[1] == TAG_LOOP)
-			{
-				sscanf((char*)&(AlgoStr[2]),"%d",&loop);
-				loopPosn = ftell(qFile);
-				continue;
-			}
-			else
-			{
-				fprintf(stderr,"unsupported tag %s\n",AlgoStr);
-				continue;
-			}
-			
-		}
-		else if (*AlgoStr == TAG_CLOSE)
-		{
-			if (loop > 1)
-			{
-				loop--;
-				fseek(qFile,loopPosn,SEEK_SET);
-			}
-			continue;
-		}
-		else if (*AlgoStr == TAG_EXEC)
-		{
-			if (AlgoStr[1] == TAG_ORACLE)
-			{
-				unsigned int oracleNum,oracleYBit;
-				char oracleParams[sizeof(algoBuf)];
-
-				sscanf(&(AlgoStr[2]),"%u %u %[^\n]s",&oracleNum,&oracleYBit,oracleParams);
-				
-				qEmul_oracle(oracleYBit,OracleList[oracleNum],oracleParams,&qList);
-				continue;
-
-			}
-			else if (AlgoStr[1] == TAG_FUNCTION)
-			{
-				unsigned int functionNum, numBit;
-				char functionParams[sizeof(algoBuf)];
-
-				sscanf(&(AlgoStr[2]),"%u %u %[^\n]s",&functionNum,&numBit,functionParams);
-				
-				qEmul_function(numBit,FunctionList[functionNum],functionParams,&qList);
-				continue;
-
-			}
-			else if (AlgoStr[1] == TAG_READ)
-			{
-				char fileName[sizeof(algoBuf)]; 
-
-				sscanf(&(AlgoStr[2]),"%s",fileName);
-				
-				qEmul_Read(numQubits,fileName,&qList);
-				continue;
-			}
-			else if (AlgoStr[1] == TAG_WRITE)
-			{
-				char fileName[sizeof(algoBuf)]; 
-
-				sscanf(&(AlgoStr[2]),"%s",fileName);
-				
-				qEmul_Write(numQubits,fileName,qList);
-				continue;
-		
-			}
-			else
-			{
-				fprintf(stderr,"unsupported tag %s\n",AlgoStr);
-				continue;
-			}
-		}
+	qEmul_CreateList(&qList);
+	// a fixed seed, to repeat a run or to tell runs started together apart
+	if ((seedStr = getenv("QUIC_SEED")) != NULL)
+		srand((unsigned int) strtoul(seedStr,NULL,10));
+	if (run.shots > 0)
+	{
+		runBranch(&qc,run,0,NULL,numQubits,&qList);
+		qCircuit_Free(&qc);
+		fprintf(stdout,"%lu shots over %lu branches\n",run.shots,branches);
+		qState_HashToList(&histogram,&histList);
+		qState_HashFree(&histogram);
+		for (currPtr = histList; currPtr; currPtr = currPtr->next)
+			printOutcome(width,0xFFFFFFFFFFFFFFFF >> (64 - width),currPtr->Value,(unsigned long) creal(currPtr->Count));
+		qEmul_FreeList(histList);
+		qEmul_FreeList(qList);
+		return 0;
+	}
 
-		while (!done)
-		{
-			if (strlen(AlgoStr) < numQubits)
-			{
-				if (*AlgoStr == DELIM_END)
-				{
-					done = 1;
-					continue;
-				}
-				else if (*AlgoStr == DELIM_PRINT)
-				{
-					memset(outString,0,sizeof(outString));
-					qEmul_PrintList(numQubits, qList,outString,sizeof(outString)-strlen(outString)-1);
-					fprintf(stdout,outString);
-				}
-				break;
-					
-			}
-			memset(nextGate,0,sizeof(nextGate));
-			memcpy(nextGate,AlgoStr,numQubits);	
-			AlgoStr += numQubits;
-			numQubits = qEmul_exec(numQubits,nextGate,&qList);
-			if (*AlgoStr != '\0')
-			{
-				if (*AlgoStr == DELIM_PRINT)
-				{
-					memset(outString,0,sizeof(outString));
-					sprintf(outString,"completed gate %s\n",nextGate);
-					qEmul_PrintList(numQubits, qList,outString,sizeof(outString)-strlen(outString)-1);
-					fprintf(stdout,outString);
-				}
-				else if (*AlgoStr == DELIM_END)
-				{
-					done = 1;
-					continue;
-				}
-				
-				AlgoStr++;
-			}
-	
-		}
-	
-	}		
-	fclose(qFile);
+	runOps(&qc,&run,0,&numQubits,&qList);
+	qCircuit_Free(&qc);
 	if ((Probability = qEmul_GetProbability())< 1.0)
 		fprintf(stdout,"probability of result is : %2.1f%% \n",Probability*100);
 	memset(outString,0,sizeof(outString));
@@ -216,4 +373,3 @@ int main(int argc, char * argv[])
 
 	
 }
-
@@ -0,0 +1,513 @@
+/******************************************
+ * Name: q_aes.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <string.h>
+#include <stdint.h>
+#include "q_aes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QAES_X86
+#endif
+
+#define QAES_SLICE_LANES 64
+
+// the AES S box of Boyar and Peralta, 32 AND and 83 XOR/XNOR gates. u[0] is
+// the top bit of the byte, and so is s[0]. every bit of the words is its own
+// byte, so this does 64 S boxes at once
+
+static void sliceSbox(uint64_t * s, const uint64_t * u)
+{
+	uint64_t t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14;
+	uint64_t t15, t16, t17, t18, t19, t20, t21, t22, t23, t24, t25, t26, t27;
+	uint64_t m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15;
+	uint64_t m16, m17, m18, m19, m20, m21, m22, m23, m24, m25, m26, m27, m28;
+	uint64_t m29, m30, m31, m32, m33, m34, m35, m36, m37, m38, m39, m40, m41;
+	uint64_t m42, m43, m44, m45, m46, m47, m48, m49, m50, m51, m52, m53, m54;
+	uint64_t m55, m56, m57, m58, m59, m60, m61, m62, m63;
+	uint64_t l0, l1, l2, l3, l4, l5, l6, l7, l8, l9, l10, l11, l12, l13, l14;
+	uint64_t l15, l16, l17, l18, l19, l20, l21, l22, l23, l24, l25, l26, l27;
+	uint64_t l28, l29;
+
+	// top linear layer
+	t1 = u[0] ^ u[3];
+	t2 = u[0] ^ u[5];
+	t3 = u[0] ^ u[6];
+	t4 = u[3] ^ u[5];
+	t5 = u[4] ^ u[6];
+	t6 = t1 ^ t5;
+	t7 = u[1] ^ u[2];
+	t8 = u[7] ^ t6;
+	t9 = u[7] ^ t7;
+	t10 = t6 ^ t7;
+	t11 = u[1] ^ u[5];
+	t12 = u[2] ^ u[5];
+	t13 = t3 ^ t4;
+	t14 = t6 ^ t11;
+	t15 = t5 ^ t11;
+	t16 = t5 ^ t12;
+	t17 = t9 ^ t16;
+	t18 = u[3] ^ u[7];
+	t19 = t7 ^ t18;
+	t20 = t1 ^ t19;
+	t21 = u[6] ^ u[7];
+	t22 = t7 ^ t21;
+	t23 = t2 ^ t22;
+	t24 = t2 ^ t10;
+	t25 = t20 ^ t17;
+	t26 = t3 ^ t16;
+	t27 = t1 ^ t12;
+
+	// inversion in GF(2^8)
+	m1 = t13 & t6;
+	m2 = t23 & t8;
+	m3 = t14 ^ m1;
+	m4 = t19 & u[7];
+	m5 = m4 ^ m1;
+	m6 = t3 & t16;
+	m7 = t22 & t9;
+	m8 = t26 ^ m6;
+	m9 = t20 & t17;
+	m10 = m9 ^ m6;
+	m11 = t1 & t15;
+	m12 = t4 & t27;
+	m13 = m12 ^ m11;
+	m14 = t2 & t10;
+	m15 = m14 ^ m11;
+	m16 = m3 ^ m2;
+	m17 = m5 ^ t24;
+	m18 = m8 ^ m7;
+	m19 = m10 ^ m15;
+	m20 = m16 ^ m13;
+	m21 = m17 ^ m15;
+	m22 = m18 ^ m13;
+	m23 = m19 ^ t25;
+	m24 = m22 ^ m23;
+	m25 = m22 & m20;
+	m26 = m21 ^ m25;
+	m27 = m20 ^ m21;
+	m28 = m23 ^ m25;
+	m29 = m28 & m27;
+	m30 = m26 & m24;
+	m31 = m20 & m23;
+	m32 = m27 & m31;
+	m33 = m27 ^ m25;
+	m34 = m21 & m22;
+	m35 = m24 & m34;
+	m36 = m24 ^ m25;
+	m37 = m21 ^ m29;
+	m38 = m32 ^ m33;
+	m39 = m23 ^ m30;
+	m40 = m35 ^ m36;
+	m41 = m38 ^ m40;
+	m42 = m37 ^ m39;
+	m43 = m37 ^ m38;
+	m44 = m39 ^ m40;
+	m45 = m42 ^ m41;
+	m46 = m44 & t6;
+	m47 = m40 & t8;
+	m48 = m39 & u[7];
+	m49 = m43 & t16;
+	m50 = m38 & t9;
+	m51 = m37 & t17;
+	m52 = m42 & t15;
+	m53 = m45 & t27;
+	m54 = m41 & t10;
+	m55 = m44 & t13;
+	m56 = m40 & t23;
+	m57 = m39 & t19;
+	m58 = m43 & t3;
+	m59 = m38 & t22;
+	m60 = m37 & t20;
+	m61 = m42 & t1;
+	m62 = m45 & t4;
+	m63 = m41 & t2;
+
+	// bottom linear layer, with the affine constant
+	l0 = m61 ^ m62;
+	l1 = m50 ^ m56;
+	l2 = m46 ^ m48;
+	l3 = m47 ^ m55;
+	l4 = m54 ^ m58;
+	l5 = m49 ^ m61;
+	l6 = m62 ^ l5;
+	l7 = m46 ^ l3;
+	l8 = m51 ^ m59;
+	l9 = m52 ^ m53;
+	l10 = m53 ^ l4;
+	l11 = m60 ^ l2;
+	l12 = m48 ^ m51;
+	l13 = m50 ^ l0;
+	l14 = m52 ^ m61;
+	l15 = m55 ^ l1;
+	l16 = m56 ^ l0;
+	l17 = m57 ^ l1;
+	l18 = m58 ^ l8;
+	l19 = m63 ^ l4;
+	l20 = l0 ^ l1;
+	l21 = l1 ^ l7;
+	l22 = l3 ^ l12;
+	l23 = l18 ^ l2;
+	l24 = l15 ^ l9;
+	l25 = l6 ^ l10;
+	l26 = l7 ^ l9;
+	l27 = l8 ^ l10;
+	l28 = l11 ^ l14;
+	l29 = l11 ^ l17;
+	s[0] = l6 ^ l24;
+	s[1] = ~(l16 ^ l26);
+	s[2] = ~(l19 ^ l28);
+	s[3] = l6 ^ l21;
+	s[4] = l20 ^ l22;
+	s[5] = l25 ^ l29;
+	s[6] = ~(l13 ^ l27);
+	s[7] = ~(l6 ^ l23);
+}
+
+// up to 64 bytes through the S box, used by the key schedule
+
+static void sboxBytes(uint8_t * b, int num)
+{
+	uint64_t u[8], s[8];
+	int i, k;
+
+	memset(u, 0, sizeof(u));
+	for (i = 0; i < num; i++)
+	{
+		for (k = 0; k < 8; k++)
+			u[k] |= (uint64_t) ((b[i] >> (7 - k)) & 1) << i;
+	}
+	sliceSbox(s, u);
+	for (i = 0; i < num; i++)
+	{
+		b[i] = 0;
+		for (k = 0; k < 8; k++)
+			b[i] |= ((s[k] >> i) & 1) << (7 - k);
+	}
+}
+
+void qAes_Schedule(QAes * aes, const uint8_t * key, int keyBits)
+{
+	uint8_t w[4 * 4 * (QAES_MAX_ROUNDS+1)];
+	uint8_t t[4], rcon = 1;
+	int nk = keyBits / 32;
+	int i, k;
+
+	aes->Rounds = nk + 6;
+	memcpy(w, key, 4 * nk);
+	for (i = nk; i < 4 * (aes->Rounds + 1); i++)
+	{
+		memcpy(t, &w[4 * (i-1)], 4);
+		if (i % nk == 0)
+		{
+			k = t[0];
+			t[0] = t[1];
+			t[1] = t[2];
+			t[2] = t[3];
+			t[3] = k;
+			sboxBytes(t, 4);
+			t[0] ^= rcon;
+			rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1b);
+		}
+		else if ((nk > 6) && (i % nk == 4))
+			sboxBytes(t, 4);
+		for (k = 0; k < 4; k++)
+			w[4*i + k] = w[4*(i-nk) + k] ^ t[k];
+	}
+	memcpy(aes->RoundKey, w, sizeof(aes->RoundKey[0]) * (aes->Rounds + 1));
+}
+
+// 64x64 bit transpose in place, row r bit c swaps with row c bit r
+
+static void transpose64(uint64_t * a)
+{
+	uint64_t m = 0x00000000FFFFFFFFULL, t;
+	int j, k;
+
+	for (j = 32; j != 0; j >>= 1, m ^= m << j)
+	{
+		for (k = 0; k < 64; k = ((k | j) + 1) & ~j)
+		{
+			t = ((a[k] >> j) ^ a[k | j]) & m;
+			a[k] ^= t << j;
+			a[k | j] ^= t;
+		}
+	}
+}
+
+// st[p][k] is bit 7-k of state byte p, for 64 blocks at once. byte p is in
+// row p%4 and column p/4 of the AES state
+
+static void sliceAddKey(uint64_t st[16][8], const uint8_t * rk)
+{
+	int p, k;
+
+	for (p = 0; p < 16; p++)
+	{
+		for (k = 0; k < 8; k++)
+			st[p][k] ^= -(uint64_t) ((rk[p] >> (7 - k)) & 1);
+	}
+}
+
+static void sliceShiftRows(uint64_t st[16][8])
+{
+	uint64_t old[16][8];
+	int r, c;
+
+	memcpy(old, st, sizeof(old));
+	for (c = 0; c < 4; c++)
+	{
+		for (r = 1; r < 4; r++)
+			memcpy(st[r + 4*c], old[r + 4*((c + r) % 4)], sizeof(old[0]));
+	}
+}
+
+// b_r = 2 (a_r ^ a_r+1) ^ a_r+1 ^ a_r+2 ^ a_r+3, times 2 being a shift of
+// the slices with 0x1b folded in from the top bit
+
+static void sliceMixColumns(uint64_t st[16][8])
+{
+	uint64_t a[4][8], x[8];
+	int r, c, k, r1, r2, r3;
+
+	for (c = 0; c < 4; c++)
+	{
+		memcpy(a, st[4*c], sizeof(a));
+		for (r = 0; r < 4; r++)
+		{
+			r1 = (r + 1) % 4;
+			r2 = (r + 2) % 4;
+			r3 = (r + 3) % 4;
+			for (k = 0; k < 8; k++)
+				x[k] = a[r][k] ^ a[r1][k];
+			for (k = 0; k < 8; k++)
+				st[r + 4*c][k] = ((k < 7) ? x[k+1] : 0) ^ a[r1][k] ^ a[r2][k] ^ a[r3][k];
+			st[r + 4*c][7] ^= x[0];
+			st[r + 4*c][6] ^= x[0];
+			st[r + 4*c][4] ^= x[0];
+			st[r + 4*c][3] ^= x[0];
+		}
+	}
+}
+
+static void encryptSliced(const QAes * aes, const uint8_t * in, uint8_t * out)
+{
+	uint64_t half[2][QAES_SLICE_LANES];
+	uint64_t st[16][8];
+	int h, j, p, k, round;
+
+	// row j of each half is 8 bytes of block j, bit 8p+7-k becomes lane j of
+	// slice k of byte p after the transpose
+	for (h = 0; h < 2; h++)
+	{
+		for (j = 0; j < QAES_SLICE_LANES; j++)
+			memcpy(&half[h][j], &in[j * QAES_BLOCK_SIZE + 8*h], 8);
+		transpose64(half[h]);
+		for (p = 0; p < 8; p++)
+		{
+			for (k = 0; k < 8; k++)
+				st[8*h + p][k] = half[h][8*p + 7 - k];
+		}
+	}
+
+	sliceAddKey(st, aes->RoundKey[0]);
+	for (round = 1; round <= aes->Rounds; round++)
+	{
+		for (p = 0; p < 16; p++)
+			sliceSbox(st[p], st[p]);
+		sliceShiftRows(st);
+		if (round != aes->Rounds)
+			sliceMixColumns(st);
+		sliceAddKey(st, aes->RoundKey[round]);
+	}
+
+	for (h = 0; h < 2; h++)
+	{
+		for (p = 0; p < 8; p++)
+		{
+			for (k = 0; k < 8; k++)
+				half[h][8*p + 7 - k] = st[8*h + p][k];
+		}
+		transpose64(half[h]);
+		for (j = 0; j < QAES_SLICE_LANES; j++)
+			memcpy(&out[j * QAES_BLOCK_SIZE + 8*h], &half[h][j], 8);
+	}
+}
+
+// the inverse cipher for single blocks, used for precomputation. the bytes
+// go through GF(2^8) arithmetic rather than tables
+
+static uint8_t gfMul(uint8_t a, uint8_t b)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		r ^= a & -(b & 1);
+		a = (a << 1) ^ (0x1b & -(a >> 7));
+		b >>= 1;
+	}
+	return r;
+}
+
+// the inverse affine map, then x^254 which is the inverse of x (and 0 for 0)
+
+static uint8_t invSbox(uint8_t y)
+{
+	uint8_t x, r = 1;
+	int i;
+
+	x = ((y << 1) | (y >> 7)) ^ ((y << 3) | (y >> 5)) ^ ((y << 6) | (y >> 2)) ^ 0x05;
+	for (i = 0; i < 7; i++)
+	{
+		x = gfMul(x, x);
+		r = gfMul(r, x);
+	}
+	return r;
+}
+
+void qAes_DecryptBlock(const QAes * aes, const uint8_t * in, uint8_t * out)
+{
+	uint8_t st[QAES_BLOCK_SIZE], old[QAES_BLOCK_SIZE], a[4];
+	int round, p, r, c;
+
+	for (p = 0; p < QAES_BLOCK_SIZE; p++)
+		st[p] = in[p] ^ aes->RoundKey[aes->Rounds][p];
+	for (round = aes->Rounds - 1; round >= 0; round--)
+	{
+		memcpy(old, st, sizeof(old));
+		for (c = 0; c < 4; c++)
+		{
+			for (r = 0; r < 4; r++)
+				st[r + 4*((c + r) % 4)] = invSbox(old[r + 4*c]);
+		}
+		for (p = 0; p < QAES_BLOCK_SIZE; p++)
+			st[p] ^= aes->RoundKey[round][p];
+		if (round == 0)
+			break;
+		for (c = 0; c < 4; c++)
+		{
+			memcpy(a, &st[4*c], 4);
+			for (r = 0; r < 4; r++)
+				st[r + 4*c] = gfMul(a[r], 0x0e) ^ gfMul(a[(r+1)%4], 0x0b) ^
+					gfMul(a[(r+2)%4], 0x0d) ^ gfMul(a[(r+3)%4], 0x09);
+		}
+	}
+	memcpy(out, st, QAES_BLOCK_SIZE);
+}
+
+#ifdef QAES_X86
+
+// 4 blocks in flight to hide the latency of aesenc
+
+#define QAES_NI_LANES 4
+
+__attribute__((target("aes,sse2")))
+static void encryptAesni(const QAes * aes, const uint8_t * in, uint8_t * out, unsigned long num)
+{
+	__m128i rk[QAES_MAX_ROUNDS+1], b[QAES_NI_LANES];
+	unsigned long n, lanes, j;
+	int round;
+
+	for (round = 0; round <= aes->Rounds; round++)
+		rk[round] = _mm_loadu_si128((const __m128i *) aes->RoundKey[round]);
+	for (n = 0; n < num; n += lanes)
+	{
+		lanes = (num - n < QAES_NI_LANES) ? num - n : QAES_NI_LANES;
+		for (j = 0; j < lanes; j++)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) &in[(n+j) * QAES_BLOCK_SIZE]), rk[0]);
+		for (round = 1; round < aes->Rounds; round++)
+		{
+			for (j = 0; j < lanes; j++)
+				b[j] = _mm_aesenc_si128(b[j], rk[round]);
+		}
+		for (j = 0; j < lanes; j++)
+			_mm_storeu_si128((__m128i *) &out[(n+j) * QAES_BLOCK_SIZE], _mm_aesenclast_si128(b[j], rk[aes->Rounds]));
+	}
+}
+
+#endif
+
+// full groups of 64 blocks are sliced in place, the last partial group
+// through a zero padded copy
+
+static void encryptSlicedRun(const QAes * aes, const uint8_t * in, uint8_t * out, unsigned long num)
+{
+	uint8_t tail[QAES_SLICE_LANES * QAES_BLOCK_SIZE];
+	unsigned long n;
+
+	for (n = 0; n + QAES_SLICE_LANES <= num; n += QAES_SLICE_LANES)
+		encryptSliced(aes, &in[n * QAES_BLOCK_SIZE], &out[n * QAES_BLOCK_SIZE]);
+	if (n < num)
+	{
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, &in[n * QAES_BLOCK_SIZE], (num - n) * QAES_BLOCK_SIZE);
+		encryptSliced(aes, tail, tail);
+		memcpy(&out[n * QAES_BLOCK_SIZE], tail, (num - n) * QAES_BLOCK_SIZE);
+	}
+}
+
+// the encryption of each level. a level is chosen by publishing one pointer
+// into this table, as in q_sha256.c
+
+typedef void (*QAesEncrypt)(const QAes * aes, const uint8_t * in, uint8_t * out, unsigned long num);
+
+static const QAesEncrypt AesImpl[] =
+{
+	&encryptSlicedRun,
+#ifdef QAES_X86
+	&encryptAesni,
+#endif
+};
+
+static const QAesEncrypt * Encrypt = NULL;
+
+int qAes_SetSimdLevel(int level)
+{
+	int best = QAES_SLICED;
+
+#ifdef QAES_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("aes"))
+		best = QAES_AESNI;
+#endif
+	if ((level < 0) || (level > best))
+		level = best;
+	Encrypt = &AesImpl[level];
+	return level;
+}
+
+// picked by qOracle_setup ahead of the oracles, which encrypt from several
+// threads at once
+
+int qAes_GetSimdLevel(void)
+{
+	if (!Encrypt)
+		qAes_SetSimdLevel(-1);
+	return Encrypt - AesImpl;
+}
+
+void qAes_Encrypt(const QAes * aes, const uint8_t * in, uint8_t * out, unsigned long num)
+{
+	qAes_GetSimdLevel();
+	(*Encrypt)(aes, in, out, num);
+}
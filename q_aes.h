@@ -0,0 +1,66 @@
+/******************************************
+ * Name: q_aes.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_AES_H
+#define Q_AES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// AES-128 and AES-256 encryption of many blocks under the same key, without
+// tables indexed by secret data. the portable path is bitsliced, 64 blocks
+// per pass with the S box as a boolean circuit. CPUs with the AES
+// instructions use them instead, picked by qOracle_setup or on first use.
+// qAes_SetSimdLevel can lower it (-1 selects the best again) and returns the
+// level actually chosen. it is not to be called while encrypting
+
+#define QAES_SLICED 0
+#define QAES_AESNI 1
+
+#define QAES_BLOCK_SIZE 16
+#define QAES_MAX_ROUNDS 14
+
+typedef struct _QAes
+{
+  int Rounds;                                          // 10 or 14
+  uint8_t RoundKey[QAES_MAX_ROUNDS+1][QAES_BLOCK_SIZE];
+} QAes;
+
+int qAes_SetSimdLevel(int level);
+int qAes_GetSimdLevel(void);
+
+// keyBits is 128 or 256, key holds keyBits/8 bytes
+void qAes_Schedule(QAes * aes, const uint8_t * key, int keyBits);
+
+// in and out are num blocks of QAES_BLOCK_SIZE bytes, and may be the same
+void qAes_Encrypt(const QAes * aes, const uint8_t * in, uint8_t * out, unsigned long num);
+
+// one block the other way, for setting up oracles. in and out may be the same
+void qAes_DecryptBlock(const QAes * aes, const uint8_t * in, uint8_t * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/******************************************
+ * Name: q_arena.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "q_arena.h"
+
+// in front of every buffer, 16 bytes so the payload stays aligned for complex
+
+typedef struct _QArenaHeader
+{
+	struct _QArenaHeader * next;   // in the cache of its class
+	unsigned long Class;
+} QArenaHeader;
+
+static QArenaHeader * Cache[QARENA_MAX_CLASS + 1];
+static int CacheCount[QARENA_MAX_CLASS + 1];
+static QArenaStats Stats;
+
+static int sizeClass(unsigned long size)
+{
+	int c = QARENA_MIN_CLASS;
+
+	size += sizeof(QArenaHeader);
+	while ((c <= QARENA_MAX_CLASS) && ((1UL << c) < size))
+		c++;
+	return c;
+}
+
+static void * arenaGet(unsigned long size, int zero)
+{
+	QArenaHeader * header = NULL;
+	int c = sizeClass(size);
+
+	if (c > QARENA_MAX_CLASS)
+		return NULL;
+
+	#pragma omp critical (qArena)
+	{
+		if (Cache[c])
+		{
+			header = Cache[c];
+			Cache[c] = header->next;
+			CacheCount[c]--;
+			Stats.BytesCached -= 1UL << c;
+			Stats.Reuses++;
+		}
+	}
+	if (header)
+	{
+		if (zero)
+			memset(header + 1, 0, size);
+	}
+	else
+	{
+		// a fresh calloc gets its zero pages lazily from the system
+		if (zero)
+			header = (QArenaHeader *) calloc(1, 1UL << c);
+		else
+			header = (QArenaHeader *) malloc(1UL << c);
+		if (!header)
+			return NULL;
+		header->Class = c;
+		#pragma omp critical (qArena)
+		Stats.Mallocs++;
+	}
+	header->next = NULL;
+
+	#pragma omp critical (qArena)
+	{
+		Stats.BytesInUse += 1UL << c;
+		if (Stats.BytesInUse > Stats.PeakBytes)
+			Stats.PeakBytes = Stats.BytesInUse;
+	}
+	return header + 1;
+}
+
+void * qArena_Alloc(unsigned long size)
+{
+	return arenaGet(size, 0);
+}
+
+void * qArena_Calloc(unsigned long size)
+{
+	return arenaGet(size, 1);
+}
+
+void qArena_Free(void * ptr)
+{
+	QArenaHeader * header;
+	int c;
+
+	if (!ptr)
+		return;
+	header = (QArenaHeader *) ptr - 1;
+	c = header->Class;
+
+	#pragma omp critical (qArena)
+	{
+		Stats.BytesInUse -= 1UL << c;
+		if (CacheCount[c] < QARENA_KEEP)
+		{
+			header->next = Cache[c];
+			Cache[c] = header;
+			CacheCount[c]++;
+			Stats.BytesCached += 1UL << c;
+			header = NULL;
+		}
+		else
+			Stats.Releases++;
+	}
+	free(header);
+}
+
+// gives every cached buffer back to the system
+
+void qArena_Trim(void)
+{
+	QArenaHeader * header;
+	int c;
+
+	#pragma omp critical (qArena)
+	{
+		for (c = 0; c <= QARENA_MAX_CLASS; c++)
+		{
+			while (Cache[c])
+			{
+				header = Cache[c];
+				Cache[c] = header->next;
+				free(header);
+				Stats.Releases++;
+			}
+			CacheCount[c] = 0;
+		}
+		Stats.BytesCached = 0;
+	}
+}
+
+void qArena_GetStats(QArenaStats * stats)
+{
+	#pragma omp critical (qArena)
+	*stats = Stats;
+}
+
+// clears the counters, the byte totals describe the pool and are kept
+
+void qArena_ResetStats(void)
+{
+	#pragma omp critical (qArena)
+	{
+		Stats.Mallocs = 0;
+		Stats.Reuses = 0;
+		Stats.Releases = 0;
+		Stats.PeakBytes = Stats.BytesInUse;
+	}
+}
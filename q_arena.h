@@ -0,0 +1,58 @@
+/******************************************
+ * Name: q_arena.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#ifndef Q_ARENA_H
+#define Q_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// buffer pool for all state storage: hash tables, dense arrays, sort scratch
+// and the exported lists. buffers are kept in power of 2 size classes and a
+// freed buffer goes back to its class, so once a simulation has warmed up the
+// buffers of one column are reused by the next without calling malloc
+
+#define QARENA_MIN_CLASS 6      // 64 bytes
+#define QARENA_MAX_CLASS 47
+#define QARENA_KEEP 4           // cached buffers per size class, more go back to the system
+
+typedef struct _QArenaStats
+{
+  unsigned long Mallocs;      // buffers obtained from the system
+  unsigned long Reuses;       // requests served from the cache
+  unsigned long Releases;     // buffers given back to the system
+  unsigned long BytesInUse;
+  unsigned long BytesCached;
+  unsigned long PeakBytes;    // highest BytesInUse
+} QArenaStats;
+
+void * qArena_Alloc(unsigned long size);
+void * qArena_Calloc(unsigned long size);
+void qArena_Free(void * ptr);
+void qArena_Trim(void);
+void qArena_GetStats(QArenaStats * stats);
+void qArena_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,267 @@
+/******************************************
+ * Name: q_cache.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "q_cache.h"
+
+#define QCACHE_NONE 0xFFFFFFFFFFFFFFFF
+#define QCACHE_MIN_SIZE 1024
+
+// the entries live in parallel arrays and are linked twice: into the chain of
+// their hash bucket, and into the LRU list from Head (newest) to Tail
+
+typedef struct _QCacheSpace
+{
+  unsigned long Owner;
+  unsigned long * Params;
+  int numParams;
+  unsigned long * Key;
+  unsigned long * Value;
+  unsigned long * Prev;
+  unsigned long * Next;
+  unsigned long * Chain;
+  unsigned long * Bucket;     // Size buckets
+  unsigned long Size;         // allocated entries, a power of 2
+  unsigned long Used;
+  unsigned long Head;
+  unsigned long Tail;
+  struct _QCacheSpace * next; // spaces, most recently opened first
+} QCacheSpace;
+
+static QCacheSpace * Spaces = NULL;
+static QCacheStats Stats;
+
+static void * allocArray(unsigned long count)
+{
+	void * ptr = malloc(count * sizeof(unsigned long));
+
+	if (!ptr)
+	{
+		fprintf(stderr,"Error: unable to malloc oracle cache\n");
+		exit(-1);
+	}
+	return ptr;
+}
+
+static unsigned long bucketOf(QCacheSpace * space, unsigned long key)
+{
+	return (key * 0x9E3779B97F4A7C15) >> (64 - __builtin_ctzl(space->Size));
+}
+
+static void freeSpace(QCacheSpace * space)
+{
+	free(space->Params);
+	free(space->Key);
+	free(space->Value);
+	free(space->Prev);
+	free(space->Next);
+	free(space->Chain);
+	free(space->Bucket);
+	free(space);
+}
+
+// doubles the entry arrays and rebuilds the buckets, the LRU links stay valid
+
+static void growSpace(QCacheSpace * space)
+{
+	unsigned long Size = space->Size ? space->Size * 2 : QCACHE_MIN_SIZE;
+	unsigned long i, b;
+
+	space->Key = (unsigned long *) realloc(space->Key, Size * sizeof(unsigned long));
+	space->Value = (unsigned long *) realloc(space->Value, Size * sizeof(unsigned long));
+	space->Prev = (unsigned long *) realloc(space->Prev, Size * sizeof(unsigned long));
+	space->Next = (unsigned long *) realloc(space->Next, Size * sizeof(unsigned long));
+	space->Chain = (unsigned long *) realloc(space->Chain, Size * sizeof(unsigned long));
+	free(space->Bucket);
+	space->Bucket = (unsigned long *) allocArray(Size);
+	if (!space->Key || !space->Value || !space->Prev || !space->Next || !space->Chain)
+	{
+		fprintf(stderr,"Error: unable to malloc oracle cache\n");
+		exit(-1);
+	}
+	space->Size = Size;
+	memset(space->Bucket, 0xFF, Size * sizeof(unsigned long));
+	for (i = 0; i < space->Used; i++)
+	{
+		b = bucketOf(space, space->Key[i]);
+		space->Chain[i] = space->Bucket[b];
+		space->Bucket[b] = i;
+	}
+}
+
+// the space of owner and params, made if needed
+
+QCacheSpace * qCache_Open(unsigned long owner, unsigned long * params, int numParams)
+{
+	QCacheSpace * space, ** link;
+	int count = 0;
+
+	for (link = &Spaces; *link; link = &((*link)->next))
+	{
+		space = *link;
+		if ((space->Owner == owner) && (space->numParams == numParams) &&
+			(memcmp(space->Params, params, numParams * sizeof(unsigned long)) == 0))
+		{
+			*link = space->next;
+			space->next = Spaces;
+			Spaces = space;
+			return space;
+		}
+	}
+
+	space = (QCacheSpace *) calloc(1, sizeof(QCacheSpace));
+	if (!space)
+	{
+		fprintf(stderr,"Error: unable to malloc oracle cache\n");
+		exit(-1);
+	}
+	space->Owner = owner;
+	space->numParams = numParams;
+	space->Params = (unsigned long *) allocArray(numParams);
+	memcpy(space->Params, params, numParams * sizeof(unsigned long));
+	space->Head = QCACHE_NONE;
+	space->Tail = QCACHE_NONE;
+	growSpace(space);
+	space->next = Spaces;
+	Spaces = space;
+
+	// drop the spaces not opened for the longest time
+	for (link = &Spaces; *link; )
+	{
+		if (++count > QCACHE_MAX_SPACES)
+		{
+			space = *link;
+			*link = space->next;
+			freeSpace(space);
+		}
+		else
+			link = &((*link)->next);
+	}
+	return Spaces;
+}
+
+// the entry holding key, and its value, or QCACHE_MISS
+
+unsigned long qCache_Find(QCacheSpace * space, unsigned long key, unsigned long * value)
+{
+	unsigned long i;
+
+	for (i = space->Bucket[bucketOf(space, key)]; i != QCACHE_NONE; i = space->Chain[i])
+	{
+		if (space->Key[i] == key)
+		{
+			*value = space->Value[i];
+			return i;
+		}
+	}
+	return QCACHE_MISS;
+}
+
+static void unlinkEntry(QCacheSpace * space, unsigned long i)
+{
+	if (space->Prev[i] != QCACHE_NONE)
+		space->Next[space->Prev[i]] = space->Next[i];
+	else
+		space->Head = space->Next[i];
+	if (space->Next[i] != QCACHE_NONE)
+		space->Prev[space->Next[i]] = space->Prev[i];
+	else
+		space->Tail = space->Prev[i];
+}
+
+static void pushEntry(QCacheSpace * space, unsigned long i)
+{
+	space->Prev[i] = QCACHE_NONE;
+	space->Next[i] = space->Head;
+	if (space->Head != QCACHE_NONE)
+		space->Prev[space->Head] = i;
+	else
+		space->Tail = i;
+	space->Head = i;
+}
+
+// a hit, entry becomes the most recently used
+
+void qCache_Use(QCacheSpace * space, unsigned long entry)
+{
+	Stats.Hits++;
+	if (space->Head == entry)
+		return;
+	unlinkEntry(space, entry);
+	pushEntry(space, entry);
+}
+
+// a miss that has been computed. a full space reuses its oldest entry
+
+void qCache_Put(QCacheSpace * space, unsigned long key, unsigned long value)
+{
+	unsigned long i, * link;
+
+	Stats.Misses++;
+	if ((space->Used == space->Size) && (space->Size < QCACHE_MAX_ENTRIES))
+		growSpace(space);
+	if ((space->Used < space->Size) && (space->Used < QCACHE_MAX_ENTRIES))
+		i = space->Used++;
+	else
+	{
+		i = space->Tail;
+		unlinkEntry(space, i);
+		for (link = &(space->Bucket[bucketOf(space, space->Key[i])]); *link != i; link = &(space->Chain[*link]))
+			;
+		*link = space->Chain[i];
+		Stats.Evictions++;
+	}
+	space->Key[i] = key;
+	space->Value[i] = value;
+	link = &(space->Bucket[bucketOf(space, key)]);
+	space->Chain[i] = *link;
+	*link = i;
+	pushEntry(space, i);
+}
+
+void qCache_CountDuplicates(unsigned long count)
+{
+	Stats.Duplicates += count;
+}
+
+void qCache_Clear(void)
+{
+	QCacheSpace * space;
+
+	while (Spaces)
+	{
+		space = Spaces;
+		Spaces = space->next;
+		freeSpace(space);
+	}
+}
+
+void qCache_GetStats(QCacheStats * stats)
+{
+	*stats = Stats;
+}
+
+void qCache_ResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
@@ -0,0 +1,63 @@
+/******************************************
+ * Name: q_cache.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_CACHE_H
+#define Q_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// results of the !O oracles kept across calls. every oracle and parameter
+// block gets its own space, a bounded LRU map from the X register value to
+// what the oracle puts into the Y register. the least recently used spaces
+// are dropped once there are more than QCACHE_MAX_SPACES.
+// qCache_Find only reads and can run on several threads at once, the other
+// calls change the LRU order and are made by one thread
+
+#define QCACHE_MAX_ENTRIES (1UL << 20)   // per space
+#define QCACHE_MAX_SPACES 8
+#define QCACHE_MISS 0xFFFFFFFFFFFFFFFF
+
+typedef struct _QCacheStats
+{
+  unsigned long Hits;         // inputs answered from the cache
+  unsigned long Misses;       // inputs the oracle had to compute
+  unsigned long Duplicates;   // inputs shared with another amplitude of the same call
+  unsigned long Evictions;    // entries dropped to stay within QCACHE_MAX_ENTRIES
+} QCacheStats;
+
+struct _QCacheSpace;
+
+struct _QCacheSpace * qCache_Open(unsigned long owner, unsigned long * params, int numParams);
+unsigned long qCache_Find(struct _QCacheSpace * space, unsigned long key, unsigned long * value);
+void qCache_Use(struct _QCacheSpace * space, unsigned long entry);
+void qCache_Put(struct _QCacheSpace * space, unsigned long key, unsigned long value);
+void qCache_CountDuplicates(unsigned long count);
+void qCache_Clear(void);
+void qCache_GetStats(QCacheStats * stats);
+void qCache_ResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/******************************************
+ * Name: q_chaskey.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <string.h>
+#include <stdint.h>
+#include "q_chaskey.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QCHASKEY_X86
+#endif
+
+// Chaskey by Nicky Mouha, as in chaskey() of q_oracle.c. for a full block
+// message the state is key ^ message ^ k1, then 12 rounds, then ^ k1 again
+
+#define ROTL(x,b) (((x) >> (32 - (b))) | ((x) << (b)))
+
+#define ROUND(v0,v1,v2,v3) \
+	do { \
+		v0 += v1; v1 = ROTL(v1, 5); v1 ^= v0; v0 = ROTL(v0,16); \
+		v2 += v3; v3 = ROTL(v3, 8); v3 ^= v2; \
+		v0 += v3; v3 = ROTL(v3,13); v3 ^= v0; \
+		v2 += v1; v1 = ROTL(v1, 7); v1 ^= v2; v2 = ROTL(v2,16); \
+	} while(0)
+
+// one lane per element of a gcc vector of 32 bit words, the same body for
+// every width
+
+#define QCHASKEY_LANES(NAME, VEC, TARGET) \
+TARGET static void NAME(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long stride) \
+{ \
+	VEC v[4]; \
+	int i; \
+\
+	for (i = 0; i < 4; i++) \
+	{ \
+		memcpy(&v[i], &msg[i * stride], sizeof(VEC)); \
+		v[i] ^= key->k[i] ^ key->k1[i]; \
+	} \
+	for (i = 0; i < 12; i++) \
+		ROUND(v[0], v[1], v[2], v[3]); \
+	for (i = 0; i < 4; i++) \
+	{ \
+		v[i] ^= key->k1[i]; \
+		memcpy(&tag[i * stride], &v[i], sizeof(VEC)); \
+	} \
+}
+
+typedef uint32_t QChasKeyVec1 __attribute__((vector_size(4)));
+QCHASKEY_LANES(tag_scalar, QChasKeyVec1, )
+
+#ifdef QCHASKEY_X86
+
+typedef uint32_t QChasKeyVec4 __attribute__((vector_size(16)));
+typedef uint32_t QChasKeyVec8 __attribute__((vector_size(32)));
+typedef uint32_t QChasKeyVec16 __attribute__((vector_size(64)));
+
+QCHASKEY_LANES(tag_sse2, QChasKeyVec4, )
+QCHASKEY_LANES(tag_avx2_lanes, QChasKeyVec8, __attribute__((target("avx2"))))
+QCHASKEY_LANES(tag_avx512_lanes, QChasKeyVec16, __attribute__((target("avx512f"))))
+
+// gcc does not add vzeroupper on return from target functions, see q_dense.c
+
+__attribute__((target("avx2")))
+static void tag_avx2(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long stride)
+{
+	tag_avx2_lanes(key, msg, tag, stride);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+static void tag_avx512(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long stride)
+{
+	tag_avx512_lanes(key, msg, tag, stride);
+	_mm256_zeroupper();
+}
+
+#endif
+
+// the functions of each level. a level is chosen by publishing one pointer
+// into this table, so a reader never sees the lanes of one level with the
+// function of another
+
+typedef struct
+{
+	void (*Lanes)(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long stride);
+	int numLanes;
+} QChasKeyImpl;
+
+static const QChasKeyImpl TagImpl[] =
+{
+	{ &tag_scalar, 1 },
+#ifdef QCHASKEY_X86
+	{ &tag_sse2, 4 },
+	{ &tag_avx2, 8 },
+	{ &tag_avx512, 16 },
+#endif
+};
+
+static const QChasKeyImpl * Tag = NULL;
+
+int qChasKey_SetSimdLevel(int level)
+{
+	int best = QCHASKEY_SCALAR;
+
+#ifdef QCHASKEY_X86
+	__builtin_cpu_init();
+	best = QCHASKEY_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		best = QCHASKEY_AVX2;
+	if (__builtin_cpu_supports("avx512f"))
+		best = QCHASKEY_AVX512;
+#endif
+	if ((level < 0) || (level > best))
+		level = best;
+	Tag = &TagImpl[level];
+	return level;
+}
+
+// picked by qOracle_setup ahead of the oracles, which tag from several
+// threads at once
+
+int qChasKey_GetSimdLevel(void)
+{
+	if (!Tag)
+		qChasKey_SetSimdLevel(-1);
+	return Tag - TagImpl;
+}
+
+// k1 is k times x in GF(2^128), the TIMESTWO of q_oracle.c
+
+void qChasKey_Schedule(QChasKey * key, const uint32_t k[4])
+{
+	memcpy(key->k, k, sizeof(key->k));
+	key->k1[0] = (k[0] << 1) ^ ((k[3] >> 31) ? 0x87 : 0x00);
+	key->k1[1] = (k[1] << 1) | (k[0] >> 31);
+	key->k1[2] = (k[2] << 1) | (k[1] >> 31);
+	key->k1[3] = (k[3] << 1) | (k[2] >> 31);
+}
+
+// full groups of lanes are done in place, the last partial group through a
+// zero padded copy
+
+void qChasKey_Tag16(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long num)
+{
+	uint32_t tailMsg[4 * 16];
+	uint32_t tailTag[4 * 16];
+	const QChasKeyImpl * impl;
+	unsigned long n, lanes;
+	int i;
+
+	qChasKey_GetSimdLevel();
+	impl = Tag;
+	lanes = impl->numLanes;
+	for (n = 0; n + lanes <= num; n += lanes)
+		impl->Lanes(key, &msg[n], &tag[n], num);
+	if (n < num)
+	{
+		memset(tailMsg, 0, sizeof(tailMsg));
+		for (i = 0; i < 4; i++)
+			memcpy(&tailMsg[i * lanes], &msg[i * num + n], (num - n) * sizeof(uint32_t));
+		impl->Lanes(key, tailMsg, tailTag, lanes);
+		for (i = 0; i < 4; i++)
+			memcpy(&tag[i * num + n], &tailTag[i * lanes], (num - n) * sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,62 @@
+/******************************************
+ * Name: q_chaskey.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_CHASKEY_H
+#define Q_CHASKEY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Chaskey-12 tags of many one block (16 byte) messages under the same key.
+// the messages go through the permutation in lanes of one SIMD register, 4
+// with SSE2, 8 with AVX2 and 16 with AVX-512, picked by qOracle_setup or on
+// first use. qChasKey_SetSimdLevel can lower it (-1 selects the best again)
+// and returns the level actually chosen. it is not to be called while tagging
+
+#define QCHASKEY_SCALAR 0
+#define QCHASKEY_SSE2 1
+#define QCHASKEY_AVX2 2
+#define QCHASKEY_AVX512 3
+
+// key schedule. a full block message only needs the key and its first subkey
+typedef struct _QChasKey
+{
+  uint32_t k[4];
+  uint32_t k1[4];
+} QChasKey;
+
+int qChasKey_SetSimdLevel(int level);
+int qChasKey_GetSimdLevel(void);
+
+void qChasKey_Schedule(QChasKey * key, const uint32_t k[4]);
+
+// the messages and tags are 4 little endian words each, kept as columns:
+// word i of message n is msg[i * num + n], and the same for tag
+void qChasKey_Tag16(const QChasKey * key, const uint32_t * msg, uint32_t * tag, unsigned long num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
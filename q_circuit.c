@@ -0,0 +1,480 @@
+/******************************************
+ * Name: q_circuit.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "q_emul.h"
+#include "q_circuit.h"
+
+#define QCIRCUIT_MAGIC "QuICbin"
+#define QCIRCUIT_LINE 10000
+
+static void * growArray(void * array, unsigned long * size, unsigned long need, unsigned long width)
+{
+	if (need <= *size)
+		return array;
+	while (*size < need)
+		*size = (*size) ? 2 * (*size) : 64;
+	array = realloc(array, (*size) * width);
+	if (!array)
+	{
+		fprintf(stderr,"Error: unable to malloc circuit\n");
+		exit(-1);
+	}
+	return array;
+}
+
+// appends an op and returns its index, the pointers into Ops move as it grows
+
+static unsigned long addOp(QCircuit * qc, int Op, int numQubits)
+{
+	QOp * op;
+
+	qc->Ops = (QOp *) growArray(qc->Ops, &(qc->sizeOps), qc->numOps + 1, sizeof(QOp));
+	op = &(qc->Ops[qc->numOps]);
+	memset(op, 0, sizeof(QOp));
+	op->Op = Op;
+	op->numQubits = numQubits;
+	return qc->numOps++;
+}
+
+static unsigned long addText(QCircuit * qc, char * text, unsigned long len)
+{
+	unsigned long offset = qc->lenText;
+
+	qc->Text = (char *) growArray(qc->Text, &(qc->sizeText), qc->lenText + len + 1, 1);
+	memcpy(&(qc->Text[offset]), text, len);
+	qc->Text[offset + len] = 0;
+	qc->lenText += len + 1;
+	return offset;
+}
+
+static unsigned long addParams(QCircuit * qc, unsigned long * params, unsigned long num)
+{
+	unsigned long offset = qc->numParams;
+
+	qc->Params = (unsigned long *) growArray(qc->Params, &(qc->sizeParams), qc->numParams + num, sizeof(unsigned long));
+	memcpy(&(qc->Params[offset]), params, num * sizeof(unsigned long));
+	qc->numParams += num;
+	return offset;
+}
+
+// the columns of one line, split the way QuICrun always has: numQubits gates
+// then one delimiter. d and c change numQubits for the columns after them.
+// returns 1 at the end delimiter
+
+static int compileColumns(QCircuit * qc, char * AlgoStr, int * numQubits)
+{
+	unsigned long i, mask;
+	int j, width;
+
+	while (1)
+	{
+		if (strlen(AlgoStr) < (size_t) *numQubits)
+		{
+			if (*AlgoStr == DELIM_END)
+				return 1;
+			else if (*AlgoStr == DELIM_PRINT)
+				addOp(qc, QOP_PRINT, *numQubits);
+			return 0;
+		}
+		i = addOp(qc, QOP_COLUMN, *numQubits);
+		qc->Ops[i].Data = addText(qc, AlgoStr, *numQubits);
+		mask = 0;
+		width = *numQubits;
+		for (j = 0; j < *numQubits; j++)
+		{
+			if (AlgoStr[j] == MEASURE)
+				mask |= 1UL << (*numQubits - 1 - j);
+			else if (AlgoStr[j] == GATE_DELETE)
+				width--;
+			else if (AlgoStr[j] == GATE_CLONE)
+				width++;
+		}
+		qc->Ops[i].Mask = mask;
+		AlgoStr += *numQubits;
+		if ((width <= 0) || (width > MAX_QUBITS))
+		{
+			fprintf(stderr,"Error: column %s leaves %d qubits\n",&(qc->Text[qc->Ops[i].Data]),width);
+			return -1;
+		}
+		*numQubits = width;
+		if (*AlgoStr != '\0')
+		{
+			if (*AlgoStr == DELIM_PRINT)
+				qc->Ops[i].Print = 1;
+			else if (*AlgoStr == DELIM_END)
+				return 1;
+			AlgoStr++;
+		}
+	}
+}
+
+// a !O or !F line: the number, the qubits and the parameters
+
+static int compileCall(QCircuit * qc, int Op, char * AlgoStr, int numQubits)
+{
+	unsigned long args[MAX_PARAMS];
+	char params[QCIRCUIT_LINE];
+	unsigned int num, bits;
+	unsigned long i;
+	int numArgs;
+
+	memset(params, 0, sizeof(params));
+	if ((sscanf(AlgoStr,"%u %u %[^\n]s",&num,&bits,params) < 2) || (num >= ((Op == QOP_ORACLE) ? MAX_ORACLE : MAX_FUNCTION)))
+	{
+		fprintf(stderr,"Error: bad call %s\n",AlgoStr);
+		return -1;
+	}
+	// the oracles get numYQubits and the value ahead of the parameters
+	numArgs = qEmul_ParseParams(params, args, (Op == QOP_ORACLE) ? MAX_PARAMS - 2 : MAX_PARAMS);
+	i = addOp(qc, Op, numQubits);
+	qc->Ops[i].Arg = num;
+	qc->Ops[i].Arg2 = bits;
+	qc->Ops[i].Data = addParams(qc, args, numArgs);
+	qc->Ops[i].Len = numArgs;
+	return 0;
+}
+
+static int compileExec(QCircuit * qc, char * AlgoStr, int numQubits)
+{
+	char str[QCIRCUIT_LINE];
+	unsigned long shots = 0;
+	unsigned long i, mask;
+	int j;
+
+	memset(str, 0, sizeof(str));
+	switch (AlgoStr[1])
+	{
+		case TAG_ORACLE:
+			return compileCall(qc, QOP_ORACLE, &(AlgoStr[2]), numQubits);
+		case TAG_FUNCTION:
+			return compileCall(qc, QOP_FUNCTION, &(AlgoStr[2]), numQubits);
+		case TAG_READ:
+		case TAG_WRITE:
+			sscanf(&(AlgoStr[2]),"%s",str);
+			i = addOp(qc, (AlgoStr[1] == TAG_READ) ? QOP_READ : QOP_WRITE, numQubits);
+			qc->Ops[i].Data = addText(qc, str, strlen(str));
+			qc->Ops[i].Len = strlen(str);
+			return 0;
+		case TAG_SAMPLE:
+			// !S <shots> <qubits>, measuring the qubits marked m
+			sscanf(&(AlgoStr[2]),"%lu %s",&shots,str);
+			mask = 0;
+			for (j = 0; (j < numQubits) && str[j]; j++)
+			{
+				if (str[j] == MEASURE)
+					mask |= 1UL << (numQubits - 1 - j);
+			}
+			i = addOp(qc, QOP_SAMPLE, numQubits);
+			qc->Ops[i].Arg = shots;
+			qc->Ops[i].Mask = mask;
+			return 0;
+	}
+	fprintf(stderr,"unsupported tag %s\n",AlgoStr);
+	return 0;
+}
+
+// reads the lines of qFile the way QuICrun did, fgets into a buffer of
+// QCIRCUIT_LINE
+
+static char ** readLines(FILE * qFile, unsigned long * numLines)
+{
+	char ** lines = NULL;
+	char algoBuf[QCIRCUIT_LINE];
+	unsigned long size = 0;
+
+	*numLines = 0;
+	while (!feof(qFile))
+	{
+		memset(algoBuf,0,sizeof(algoBuf));
+		fgets(algoBuf,sizeof(algoBuf)-1,qFile);
+		lines = (char **) growArray(lines, &size, *numLines + 1, sizeof(char *));
+		if (!(lines[*numLines] = strdup(algoBuf)))
+		{
+			fprintf(stderr,"Error: unable to malloc circuit\n");
+			exit(-1);
+		}
+		(*numLines)++;
+	}
+	return lines;
+}
+
+// the loop count is a single register, as it always was: {L n} sets it and
+// the next } goes back to the line after the {L while it is more than 1. a
+// loop is kept as a jump when its body leaves the number of qubits as it
+// was, otherwise its columns would split differently on every pass and the
+// body is compiled once per pass instead
+
+int qCircuit_Compile(FILE * qFile, int numQubits, QCircuit * qc)
+{
+	char ** lines;
+	char * AlgoStr;
+	unsigned long numLines, l;
+	unsigned long loopLine = 0, loopOp = 0;
+	int loop = 0, loopWidth = -1;
+	int done = 0;
+
+	memset(qc, 0, sizeof(QCircuit));
+	qc->numQubits = numQubits;
+	lines = readLines(qFile, &numLines);
+	for (l = 0; (l < numLines) && !done; )
+	{
+		AlgoStr = lines[l++];
+		if (*AlgoStr == TAG_COMMENT)
+			continue;
+		else if (*AlgoStr == TAG_OPEN)
+		{
+			if (AlgoStr[1] == TAG_LOOP)
+			{
+				sscanf((char*)&(AlgoStr[2]),"%d",&loop);
+				loopLine = l;
+				loopWidth = numQubits;
+				loopOp = addOp(qc, QOP_LOOP, numQubits);
+				qc->Ops[loopOp].Arg = loop;
+			}
+			else
+				fprintf(stderr,"unsupported tag %s\n",AlgoStr);
+		}
+		else if (*AlgoStr == TAG_CLOSE)
+		{
+			if (loop > 1)
+			{
+				if (numQubits == loopWidth)
+				{
+					qc->Ops[addOp(qc, QOP_CLOSE, numQubits)].Arg = loopOp + 1;
+					loop = 1;
+				}
+				else
+				{
+					loop--;
+					l = loopLine;
+					loopWidth = -1;
+				}
+			}
+		}
+		else if (*AlgoStr == TAG_EXEC)
+			done = compileExec(qc, AlgoStr, numQubits);
+		else
+			done = compileColumns(qc, AlgoStr, &numQubits);
+	}
+	for (l = 0; l < numLines; l++)
+		free(lines[l]);
+	free(lines);
+	if (done < 0)
+	{
+		qCircuit_Free(qc);
+		return -1;
+	}
+	addOp(qc, QOP_END, numQubits);
+	return 0;
+}
+
+void qCircuit_Free(QCircuit * qc)
+{
+	free(qc->Ops);
+	free(qc->Text);
+	free(qc->Params);
+	memset(qc, 0, sizeof(QCircuit));
+}
+
+// the header, then the three arrays. QOp is written as it is in memory, so a
+// saved circuit is for the build that saved it
+
+typedef struct _QCircuitHeader
+{
+  char Magic[8];
+  int Version;
+  int OpSize;
+  int numQubits;
+  unsigned long numOps;
+  unsigned long lenText;
+  unsigned long numParams;
+} QCircuitHeader;
+
+int qCircuit_Save(QCircuit * qc, char * fileName)
+{
+	QCircuitHeader header;
+	FILE * fp;
+	int ok;
+
+	if (!(fp = fopen(fileName,"wb")))
+	{
+		fprintf(stderr,"Error: Unable to open <%s> for writing\n",fileName);
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	strcpy(header.Magic, QCIRCUIT_MAGIC);
+	header.Version = QCIRCUIT_VERSION;
+	header.OpSize = sizeof(QOp);
+	header.numQubits = qc->numQubits;
+	header.numOps = qc->numOps;
+	header.lenText = qc->lenText;
+	header.numParams = qc->numParams;
+	ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+	ok = ok && (fwrite(qc->Ops, sizeof(QOp), qc->numOps, fp) == qc->numOps);
+	ok = ok && (fwrite(qc->Text, 1, qc->lenText, fp) == qc->lenText);
+	ok = ok && (fwrite(qc->Params, sizeof(unsigned long), qc->numParams, fp) == qc->numParams);
+	if (fclose(fp) || !ok)
+	{
+		fprintf(stderr,"Error: unable to write <%s>\n",fileName);
+		return -1;
+	}
+	return 0;
+}
+
+// every offset is checked, a damaged file is refused rather than run. the
+// ops are walked in order with the number of qubits the columns before them
+// leave, which every op has to have been compiled for. a loop body leaves it
+// as it was, so going back to the start of the body does not change it
+
+static int checkCircuit(QCircuit * qc)
+{
+	QOp * op;
+	unsigned long i;
+	int j, width = qc->numQubits;
+
+	if ((qc->numQubits <= 0) || (qc->numQubits > MAX_QUBITS))
+		return -1;
+	if ((qc->lenText > 0) && (qc->Text[qc->lenText - 1] != 0))
+		return -1;
+	if ((qc->numOps == 0) || (qc->Ops[qc->numOps - 1].Op != QOP_END))
+		return -1;
+	for (i = 0; i < qc->numOps; i++)
+	{
+		op = &(qc->Ops[i]);
+		if (op->numQubits != width)
+			return -1;
+		switch (op->Op)
+		{
+			case QOP_COLUMN:
+				if ((op->Data >= qc->lenText) || (qc->lenText - op->Data <= (unsigned long) op->numQubits))
+					return -1;
+				for (j = 0; j < op->numQubits; j++)
+				{
+					if (qc->Text[op->Data + j] == GATE_DELETE)
+						width--;
+					else if (qc->Text[op->Data + j] == GATE_CLONE)
+						width++;
+				}
+				if ((width <= 0) || (width > MAX_QUBITS))
+					return -1;
+				break;
+			case QOP_READ:
+			case QOP_WRITE:
+				if (op->Data >= qc->lenText)
+					return -1;
+				break;
+			case QOP_ORACLE:
+			case QOP_FUNCTION:
+				// the oracles get numYQubits and the value ahead of the parameters
+				if ((op->Arg >= ((op->Op == QOP_ORACLE) ? MAX_ORACLE : MAX_FUNCTION)) || (op->Arg2 > 8 * sizeof(unsigned long)) ||
+					(op->Len > ((op->Op == QOP_ORACLE) ? MAX_PARAMS - 2 : MAX_PARAMS)) || (op->Data > qc->numParams) || (qc->numParams - op->Data < op->Len))
+					return -1;
+				break;
+			case QOP_LOOP:
+				// the count goes into an int
+				if (op->Arg > 0x7FFFFFFF)
+					return -1;
+				break;
+			case QOP_CLOSE:
+				// jumps back to the start of the body of its loop, which runs
+				// on as many qubits as the close
+				if ((op->Arg == 0) || (op->Arg > i) || (qc->Ops[op->Arg - 1].Op != QOP_LOOP) ||
+					(qc->Ops[op->Arg - 1].numQubits != op->numQubits))
+					return -1;
+				break;
+			case QOP_SAMPLE:
+				if (op->Mask >> op->numQubits)
+					return -1;
+				break;
+			case QOP_PRINT:
+			case QOP_END:
+				break;
+			default:
+				return -1;
+		}
+	}
+	return 0;
+}
+
+// returns 1 if fileName is not a saved circuit, so it can be compiled instead
+
+int qCircuit_Load(char * fileName, QCircuit * qc)
+{
+	QCircuitHeader header;
+	FILE * fp;
+	unsigned long left;
+	long end;
+	int ok;
+
+	memset(qc, 0, sizeof(QCircuit));
+	if (!(fp = fopen(fileName,"rb")))
+	{
+		fprintf(stderr,"Error: Unable to open <%s> for reading\n",fileName);
+		return -1;
+	}
+	if ((fread(&header, sizeof(header), 1, fp) != 1) || memcmp(header.Magic, QCIRCUIT_MAGIC, sizeof(header.Magic)))
+	{
+		fclose(fp);
+		return 1;
+	}
+	if ((header.Version != QCIRCUIT_VERSION) || (header.OpSize != sizeof(QOp)))
+	{
+		fprintf(stderr,"Error: <%s> was saved by another version\n",fileName);
+		fclose(fp);
+		return -1;
+	}
+	// the arrays have to be in the file before anything is allocated for them
+	ok = (fseek(fp, 0, SEEK_END) == 0) && ((end = ftell(fp)) >= (long) sizeof(header)) &&
+		(fseek(fp, sizeof(header), SEEK_SET) == 0);
+	if (ok)
+	{
+		left = end - sizeof(header);
+		ok = (header.numOps <= left / sizeof(QOp)) && (header.lenText <= left - header.numOps * sizeof(QOp)) &&
+			(header.numParams <= (left - header.numOps * sizeof(QOp) - header.lenText) / sizeof(unsigned long));
+	}
+	if (!ok)
+	{
+		fprintf(stderr,"Error: <%s> is not a valid circuit\n",fileName);
+		fclose(fp);
+		return -1;
+	}
+	qc->numQubits = header.numQubits;
+	qc->Ops = (QOp *) growArray(NULL, &(qc->sizeOps), header.numOps, sizeof(QOp));
+	qc->Text = (char *) growArray(NULL, &(qc->sizeText), header.lenText, 1);
+	qc->Params = (unsigned long *) growArray(NULL, &(qc->sizeParams), header.numParams, sizeof(unsigned long));
+	qc->numOps = header.numOps;
+	qc->lenText = header.lenText;
+	qc->numParams = header.numParams;
+	ok = (fread(qc->Ops, sizeof(QOp), qc->numOps, fp) == qc->numOps);
+	ok = ok && (fread(qc->Text, 1, qc->lenText, fp) == qc->lenText);
+	ok = ok && (fread(qc->Params, sizeof(unsigned long), qc->numParams, fp) == qc->numParams);
+	fclose(fp);
+	if (!ok || checkCircuit(qc))
+	{
+		fprintf(stderr,"Error: <%s> is not a valid circuit\n",fileName);
+		qCircuit_Free(qc);
+		return -1;
+	}
+	return 0;
+}
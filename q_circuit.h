@@ -0,0 +1,98 @@
+/******************************************
+ * Name: q_circuit.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+
+#ifndef Q_CIRCUIT_H
+#define Q_CIRCUIT_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a QuICrun circuit file parsed once into a list of ops. the columns are
+// split and sized, the oracle and function parameters are read into numbers
+// and the loops are turned into jumps, so running it reads no text. the
+// strings and parameters live in two pools and the ops hold offsets into
+// them, so a circuit is saved and loaded as it is
+
+#define TAG_COMMENT '#'
+#define TAG_OPEN '{'
+#define TAG_CLOSE '}'
+#define TAG_LOOP 'L'
+
+#define TAG_EXEC '!'
+#define TAG_ORACLE 'O'
+#define TAG_FUNCTION 'F'
+#define TAG_WRITE 'W'
+#define TAG_READ 'R'
+#define TAG_SAMPLE 'S'
+
+#define QOP_COLUMN   0   // qEmul_exec of the Text at Data, on numQubits qubits
+#define QOP_PRINT    1   // a _ line, prints the list
+#define QOP_END      2
+#define QOP_LOOP     3   // sets the loop count to Arg
+#define QOP_CLOSE    4   // jumps to Arg while the loop count is more than 1
+#define QOP_ORACLE   5   // oracle Arg, Arg2 Y qubits, Len parameters at Data
+#define QOP_FUNCTION 6   // function Arg, Arg2 bits, Len parameters at Data
+#define QOP_READ     7   // the file named at Data
+#define QOP_WRITE    8
+#define QOP_SAMPLE   9   // Arg shots of the qubits in Mask
+
+#define QCIRCUIT_VERSION 1
+
+typedef struct _QOp
+{
+  int Op;
+  int numQubits;              // qubits when the op runs
+  int Print;                  // column followed by DELIM_PRINT
+  unsigned long Arg;
+  unsigned long Arg2;
+  unsigned long Mask;         // qubits measured by a column, or sampled
+  unsigned long Data;         // offset into Text or Params
+  unsigned long Len;
+} QOp;
+
+typedef struct _QCircuit
+{
+  int numQubits;              // what it was compiled for
+  QOp * Ops;
+  unsigned long numOps;
+  unsigned long sizeOps;
+  char * Text;                // columns and file names, each ending in 0
+  unsigned long lenText;
+  unsigned long sizeText;
+  unsigned long * Params;
+  unsigned long numParams;
+  unsigned long sizeParams;
+} QCircuit;
+
+int qCircuit_Compile(FILE * qFile, int numQubits, QCircuit * qc);
+int qCircuit_Save(QCircuit * qc, char * fileName);
+int qCircuit_Load(char * fileName, QCircuit * qc);
+void qCircuit_Free(QCircuit * qc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,354 @@
+/******************************************
+ * Name: q_column.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "q_emul.h"
+#include "q_column.h"
+
+#define PI (2 * acos(0.0))
+
+int qColumn_Fusable(char gate)
+{
+	switch (gate)
+	{
+		case GATE_H: case GATE_Ht: case GATE_Hb:
+		case GATE_X: case GATE_N: case GATE_P: case GATE_T:
+		case GATE_I: case GATE_C:
+		case ORACLE_ADD: case ORACLE_SUB: case ORACLE_MUL: case ORACLE_DIV:
+		case ORACLE_POW: case ORACLE_MOD: case ORACLE_NUM:
+			return 1;
+	}
+	return 0;
+}
+
+static void addStage(QColumn * qCol, int Op, unsigned long mask)
+{
+	QStage * stage = &(qCol->Stage[qCol->numStages++]);
+
+	stage->Op = Op;
+	stage->Mask = mask;
+	stage->Half = 0;
+	if ((Op == QSTAGE_H) || (Op == QSTAGE_Ht) || (Op == QSTAGE_Hb))
+	{
+		stage->Half = 1UL << qCol->numBranch;
+		qCol->Branch |= mask;
+		qCol->numBranch++;
+	}
+}
+
+static QColumnDesc Cache[QCOLUMN_CACHE_SIZE];
+
+static unsigned long hashColumn(int numQubits, char * qAlgo)
+{
+	unsigned long h = 0xcbf29ce484222325 ^ numQubits;  // FNV-1a
+	int i;
+
+	for (i = 0; i < numQubits; i++)
+		h = (h ^ (unsigned char) qAlgo[i]) * 0x100000001b3;
+	return h;
+}
+
+static void describe(int numQubits, char * qAlgo, QColumnDesc * desc)
+{
+	unsigned long tempVal = 1;
+	int nGates = 0;
+	int i;
+
+	memset(desc, 0, sizeof(QColumnDesc));
+	desc->numQubits = numQubits;
+	memcpy(desc->Algo, qAlgo, numQubits);
+	desc->Identity = 1;
+	tempVal <<= numQubits - 1;
+	for (i = 0; i < numQubits; i++, tempVal >>= 1)
+	{
+		switch (qAlgo[i])
+		{
+			case GATE_C: desc->cMask |= tempVal; break;
+			case GATE_N: nGates++; break;
+			case GATE_SWAP: desc->swapMask |= tempVal; break;
+			case GATE_QFT: desc->qftMask |= tempVal; break;
+			case ORACLE_NUM: desc->Oracle[0] |= tempVal; break;
+			case ORACLE_ADD: desc->Oracle[1] |= tempVal; break;
+			case ORACLE_SUB: desc->Oracle[2] |= tempVal; break;
+			case ORACLE_MUL: desc->Oracle[3] |= tempVal; break;
+			case ORACLE_DIV: desc->Oracle[4] |= tempVal; break;
+			case ORACLE_MOD: desc->Oracle[5] |= tempVal; break;
+			case ORACLE_POW: desc->Oracle[6] |= tempVal; break;
+			case ORACLE_EQ: desc->Oracle[7] |= tempVal; break;
+		}
+		// t is both Ht and INVQFT, the fused pass takes it as Ht
+		if (qAlgo[i] == GATE_INVQFT)
+			desc->invQftMask |= tempVal;
+		// the same as the pass from 0 covering the column and being empty
+		if (!qColumn_Fusable(qAlgo[i]) || (qAlgo[i] == GATE_H) || (qAlgo[i] == GATE_Ht) || (qAlgo[i] == GATE_Hb) ||
+			(qAlgo[i] == GATE_X) || (qAlgo[i] == GATE_P) || (qAlgo[i] == GATE_T))
+			desc->Identity = 0;
+	}
+	if (nGates && desc->cMask)
+		desc->Identity = 0;
+}
+
+// fills desc for the column qAlgo, from the cache when it has been seen
+// before. not for several threads at once
+
+void qColumn_Describe(int numQubits, char * qAlgo, QColumnDesc * desc)
+{
+	QColumnDesc * slot = &(Cache[hashColumn(numQubits, qAlgo) % QCOLUMN_CACHE_SIZE]);
+
+	if ((slot->numQubits != numQubits) || memcmp(slot->Algo, qAlgo, numQubits))
+		describe(numQubits, qAlgo, slot);
+	*desc = *slot;
+}
+
+// compiles the column from position start up to the first gate that is not
+// fusable, or until QCOLUMN_MAX_BRANCH branching qubits are used. returns the
+// position where the next pass starts
+
+int qColumn_Compile(QColumnDesc * desc, int start, QColumn * qCol)
+{
+	int numQubits = desc->numQubits;
+	char * qAlgo = desc->Algo;
+	unsigned long mask = 1;
+	unsigned long y;
+	int i, b;
+
+	memset(qCol, 0, sizeof(QColumn) - sizeof(qCol->Offset));
+	qCol->cMask = desc->cMask;
+
+	mask <<= numQubits - 1 - start;
+	for (i = start; i < numQubits; i++, mask >>= 1)
+	{
+		if (!qColumn_Fusable(qAlgo[i]))
+			break;
+		if ((qAlgo[i] == GATE_H) || (qAlgo[i] == GATE_Ht) || (qAlgo[i] == GATE_Hb))
+		{
+			if (qCol->numBranch == QCOLUMN_MAX_BRANCH)
+				break;
+			if (qAlgo[i] == GATE_H)
+				addStage(qCol, QSTAGE_H, mask);
+			else if (qAlgo[i] == GATE_Ht)
+				addStage(qCol, QSTAGE_Ht, mask);
+			else
+				addStage(qCol, QSTAGE_Hb, mask);
+		}
+		else if (qAlgo[i] == GATE_X)
+			qCol->xMask |= mask;
+		else if (qAlgo[i] == GATE_N)
+		{
+			if (qCol->cMask != 0) // no controls, no-op
+				qCol->nMask |= mask;
+		}
+		else if (qAlgo[i] == GATE_P)
+			addStage(qCol, QSTAGE_P, mask);
+		else if (qAlgo[i] == GATE_T)
+			addStage(qCol, QSTAGE_T, mask);
+	}
+
+	for (y = 0; y < (1UL << qCol->numBranch); y++)
+	{
+		qCol->Offset[y] = 0;
+		for (b = 0; b < qCol->numStages; b++)
+		{
+			if (y & qCol->Stage[b].Half)
+				qCol->Offset[y] |= qCol->Stage[b].Mask;
+		}
+	}
+	return i;
+}
+
+// expected number of entries after the pass on a sparse state: every coset
+// fills up to 2^numBranch values, and the cosets are counted from how full a
+// few sampled ones already are
+
+#define QCOLUMN_SAMPLES 16
+
+unsigned long qColumn_Estimate(QColumn * qCol, QStore * curr)
+{
+	QState entry;
+	unsigned long live = qState_StoreLive(curr);
+	unsigned long size = 1UL << qCol->numBranch;
+	unsigned long pos = 0;
+	unsigned long members = 0;
+	unsigned long base, y;
+	double complex Count;
+	int samples = 0;
+
+	if (qCol->numBranch == 0)
+		return live;
+	while ((samples < QCOLUMN_SAMPLES) && qState_StoreNext(curr, &pos, &entry))
+	{
+		base = entry.Value & ~(qCol->Branch);
+		for (y = 0; y < size; y++)
+		{
+			if (qState_StoreGet(curr, base | qCol->Offset[y], &Count))
+				members++;
+		}
+		samples++;
+	}
+	if (members == 0)
+		return 0;
+	return live * size * samples / members;
+}
+
+// the butterflies and phases of the column, in column order, on the coset of base
+
+static void runStages(QColumn * qCol, unsigned long base, double complex * vec, unsigned long size)
+{
+	double complex a0, a1;
+	unsigned long y;
+	QStage * stage;
+	int s;
+
+	for (s = 0; s < qCol->numStages; s++)
+	{
+		stage = &(qCol->Stage[s]);
+		switch (stage->Op)
+		{
+			case QSTAGE_H:
+				for (y = 0; y < size; y++)
+				{
+					if (y & stage->Half)
+						continue;
+					a0 = vec[y];
+					a1 = vec[y | stage->Half];
+					vec[y] = a0 + a1;
+					vec[y | stage->Half] = a0 - a1;
+				}
+				break;
+			case QSTAGE_Ht:
+				for (y = 0; y < size; y++)
+				{
+					if (y & stage->Half)
+						continue;
+					vec[y] = vec[y] + vec[y | stage->Half];
+					vec[y | stage->Half] = 0;
+				}
+				break;
+			case QSTAGE_Hb:
+				for (y = 0; y < size; y++)
+				{
+					if (y & stage->Half)
+						continue;
+					vec[y | stage->Half] = vec[y] - vec[y | stage->Half];
+					vec[y] = 0;
+				}
+				break;
+			case QSTAGE_P:
+			case QSTAGE_T:
+				// allow for when cMask == 0
+				if (((base & qCol->cMask) != qCol->cMask) || !(base & stage->Mask))
+					break;
+				for (y = 0; y < size; y++)
+				{
+					if (vec[y] == 0)
+						continue;
+					if (stage->Op == QSTAGE_P)
+						vec[y] = vec[y] * (cos(PI/2) + sin(PI/2)*_Complex_I);
+					else
+						vec[y] = vec[y] * (1 + _Complex_I) / sqrt(2.0) ; // e^{pi/4}
+				}
+				break;
+		}
+	}
+}
+
+// relabels the coset and adds its non-zero amplitudes to next
+
+static void addCoset(QColumn * qCol, unsigned long base, double complex * vec, unsigned long size, QStore * next)
+{
+	unsigned long y;
+
+	base ^= qCol->xMask;
+	if ((qCol->cMask != 0) && ((base & qCol->cMask) == qCol->cMask))
+		base ^= qCol->nMask;
+	for (y = 0; y < size; y++)
+	{
+		if (vec[y] != 0)
+			qState_StoreAdd(next, base | qCol->Offset[y], vec[y]);
+	}
+}
+
+// runs the column on the coset of entry, which has just been read from curr.
+// the other members are taken out of curr so each coset is only done once
+
+void qColumn_Coset(QColumn * qCol, QStore * curr, QState * entry, QStore * next)
+{
+	double complex vec[1 << QCOLUMN_MAX_BRANCH];
+	unsigned long size = 1UL << qCol->numBranch;
+	unsigned long base = entry->Value & ~(qCol->Branch);
+	unsigned long Value, y;
+
+	for (y = 0; y < size; y++)
+	{
+		Value = base | qCol->Offset[y];
+		if (Value == entry->Value)
+			vec[y] = entry->Count;
+		else
+			qState_StoreTake(curr, Value, &vec[y]);
+	}
+	runStages(qCol, base, vec, size);
+	addCoset(qCol, base, vec, size, next);
+}
+
+// whether the shares emitted by qColumn_Emit add up to what the coset gives,
+// bit for bit. with one branching qubit each output is the sum of two shares,
+// taken in the same order as the butterfly. a second branching qubit, or a
+// phase after the butterfly, would round the sums in a different order
+
+int qColumn_Emittable(QColumn * qCol)
+{
+	int s, branched = 0;
+
+	if (qCol->numBranch > 1)
+		return 0;
+	for (s = 0; s < qCol->numStages; s++)
+	{
+		if (qCol->Stage[s].Op < QSTAGE_P)
+			branched = 1;
+		else if (branched)
+			return 0;
+	}
+	return 1;
+}
+
+// runs the column on entry alone and emits its share of the outputs, which
+// the sorted store adds up with the shares of the other coset members. no
+// lookups in curr, so the entries can be done in any order
+
+void qColumn_Emit(QColumn * qCol, QState * entry, QStore * next)
+{
+	double complex vec[1 << QCOLUMN_MAX_BRANCH];
+	unsigned long size = 1UL << qCol->numBranch;
+	unsigned long base = entry->Value & ~(qCol->Branch);
+	unsigned long y = 0;
+	int s;
+
+	memset(vec, 0, size * sizeof(double complex));
+	for (s = 0; s < qCol->numStages; s++)
+	{
+		if (entry->Value & qCol->Stage[s].Mask & qCol->Branch)
+			y |= qCol->Stage[s].Half;
+	}
+	vec[y] = entry->Count;
+	runStages(qCol, base, vec, size);
+	addCoset(qCol, base, vec, size, next);
+}
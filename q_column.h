@@ -0,0 +1,101 @@
+/******************************************
+ * Name: q_column.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#ifndef Q_COLUMN_H
+#define Q_COLUMN_H
+
+#include <complex.h>
+#include "q_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a run of single qubit gates (H X N P T t b) in one column, compiled into a
+// single pass over the state. the gates act on different qubits so they only
+// interact through the amplitudes:
+//   the X and N qubits relabel the Value (permutation part)
+//   the P and T qubits multiply the amplitude (diagonal part)
+//   the H, t and b qubits mix the entries of a coset, the values that only
+//   differ in those qubits (branching part)
+// the butterflies and phases are applied to each coset in column order, so the
+// results are the same as applying the gates one by one
+
+#define QCOLUMN_MAX_BRANCH 10   // cosets of up to 2^10 amplitudes per pass
+#define QCOLUMN_EMIT_FILL 2     // a sorted state emits per entry while cosets hold at most 2 on average
+
+#define QSTAGE_H  0
+#define QSTAGE_Ht 1
+#define QSTAGE_Hb 2
+#define QSTAGE_P  3
+#define QSTAGE_T  4
+
+typedef struct _QStage
+{
+  int Op;
+  unsigned long Mask;         // qubit of the gate
+  unsigned long Half;         // its stride in the coset, for the branching stages
+} QStage;
+
+typedef struct _QColumn
+{
+  unsigned long cMask;        // C qubits, control N P and T
+  unsigned long xMask;
+  unsigned long nMask;
+  unsigned long Branch;       // H t b qubits
+  int numBranch;
+  int numStages;
+  QStage Stage[64];
+  unsigned long Offset[1 << QCOLUMN_MAX_BRANCH];  // coset index to Branch bits
+} QColumn;
+
+#define QCOLUMN_EMPTY(c) (((c)->numStages == 0) && ((c)->xMask == 0) && ((c)->nMask == 0))
+
+// what qEmul_exec needs from the whole column before running its gates: the
+// qubits of each kind that work together. worked out once per column string
+// and kept in a small cache, as circuits repeat the same columns
+
+#define QCOLUMN_CACHE_SIZE 256  // direct mapped by a hash of the column
+
+typedef struct _QColumnDesc
+{
+  int numQubits;
+  char Algo[64];              // the column, up to MAX_QUBITS and the 0
+  int Identity;               // leaves the list as it is
+  unsigned long cMask;        // C qubits
+  unsigned long swapMask;
+  unsigned long qftMask;
+  unsigned long invQftMask;
+  unsigned long Oracle[8];    // n + - * / % ^ = masks, as STEP_ORACLE takes them
+} QColumnDesc;
+
+int qColumn_Fusable(char gate);
+void qColumn_Describe(int numQubits, char * qAlgo, QColumnDesc * desc);
+int qColumn_Compile(QColumnDesc * desc, int start, QColumn * qCol);
+unsigned long qColumn_Estimate(QColumn * qCol, QStore * curr);
+void qColumn_Coset(QColumn * qCol, QStore * curr, struct _QState * entry, QStore * next);
+int qColumn_Emittable(QColumn * qCol);
+void qColumn_Emit(QColumn * qCol, struct _QState * entry, QStore * next);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
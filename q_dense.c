@@ -0,0 +1,739 @@
+/******************************************
+ * Name: q_dense.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "q_emul.h"
+#include "q_dense.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QDENSE_X86
+#endif
+
+#define PI (2 * acos(0.0))
+
+// every kernel works on runs: a0[0..len-1] holds the amplitudes with the target
+// bit cleared and a1[0..len-1] (when used) the matching ones with it set
+
+typedef struct _QDenseKernels
+{
+	unsigned long (*Butterfly)(double complex * a0, double complex * a1, unsigned long len);
+	void (*Swap)(double complex * a0, double complex * a1, unsigned long len);
+	void (*Phase)(double complex * a, unsigned long len, double pr, double pi, double div);
+	unsigned long (*Live)(double complex * a, unsigned long len);
+} QDenseKernels;
+
+static QDenseKernels Kernels;
+static int KernelLevel = -1;
+
+/*************** scalar ***************/
+
+static unsigned long butterfly_scalar(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	double complex x0, x1;
+
+	for (j = 0; j < len; j++)
+	{
+		x0 = a0[j];
+		x1 = a1[j];
+		a0[j] = x0 + x1;
+		a1[j] = x0 - x1;
+		live += (a0[j] != 0) + (a1[j] != 0);
+	}
+	return live;
+}
+
+static void swap_scalar(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	double complex x0;
+
+	for (j = 0; j < len; j++)
+	{
+		x0 = a0[j];
+		a0[j] = a1[j];
+		a1[j] = x0;
+	}
+}
+
+static void phase_scalar(double complex * a, unsigned long len, double pr, double pi, double div)
+{
+	unsigned long j;
+	double complex phase = pr + pi*_Complex_I;
+
+	for (j = 0; j < len; j++)
+		a[j] = a[j] * phase / div;
+}
+
+static unsigned long live_scalar(double complex * a, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+
+	for (j = 0; j < len; j++)
+		live += (a[j] != 0);
+	return live;
+}
+
+#ifdef QDENSE_X86
+
+/*************** SSE2, one amplitude per register ***************/
+
+// also used for the tails of the wider kernels. inlining them there keeps the
+// tails VEX encoded, avoiding the SSE/AVX transition penalty
+
+static inline __attribute__((always_inline))
+unsigned long butterfly_sse2(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m128d x0, x1, s, d;
+	__m128d zero = _mm_setzero_pd();
+
+	for (j = 0; j < len; j++)
+	{
+		x0 = _mm_loadu_pd((double *) &a0[j]);
+		x1 = _mm_loadu_pd((double *) &a1[j]);
+		s = _mm_add_pd(x0, x1);
+		d = _mm_sub_pd(x0, x1);
+		_mm_storeu_pd((double *) &a0[j], s);
+		_mm_storeu_pd((double *) &a1[j], d);
+		live += (_mm_movemask_pd(_mm_cmpneq_pd(s, zero)) != 0);
+		live += (_mm_movemask_pd(_mm_cmpneq_pd(d, zero)) != 0);
+	}
+	return live;
+}
+
+static inline __attribute__((always_inline))
+void swap_sse2(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	__m128d x0, x1;
+
+	for (j = 0; j < len; j++)
+	{
+		x0 = _mm_loadu_pd((double *) &a0[j]);
+		x1 = _mm_loadu_pd((double *) &a1[j]);
+		_mm_storeu_pd((double *) &a0[j], x1);
+		_mm_storeu_pd((double *) &a1[j], x0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void phase_sse2(double complex * a, unsigned long len, double pr, double pi, double div)
+{
+	unsigned long j;
+	__m128d vr = _mm_set1_pd(pr);
+	__m128d vi = _mm_set1_pd(pi);
+	__m128d vd = _mm_set1_pd(div);
+	__m128d sign = _mm_set_pd(0.0, -0.0);   // negate the real half
+	__m128d x, t1, t2;
+
+	for (j = 0; j < len; j++)
+	{
+		x = _mm_loadu_pd((double *) &a[j]);
+		t1 = _mm_mul_pd(x, vr);                                     // (re*pr, im*pr)
+		t2 = _mm_mul_pd(_mm_shuffle_pd(x, x, 1), vi);               // (im*pi, re*pi)
+		x = _mm_add_pd(t1, _mm_xor_pd(t2, sign));
+		if (div != 1.0)
+			x = _mm_div_pd(x, vd);
+		_mm_storeu_pd((double *) &a[j], x);
+	}
+}
+
+static inline __attribute__((always_inline))
+unsigned long live_sse2(double complex * a, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m128d zero = _mm_setzero_pd();
+
+	for (j = 0; j < len; j++)
+		live += (_mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd((double *) &a[j]), zero)) != 0);
+	return live;
+}
+
+/*************** AVX2, two amplitudes per register ***************/
+
+// gcc does not add vzeroupper on return from target("avx2") functions, so the
+// wide kernels clear the upper halves themselves before going back to SSE code
+
+// number of non-zero amplitudes for each 4 bit movemask of (re0,im0,re1,im1)
+static const unsigned char LivePairs[16] = {0,1,1,1,1,2,2,2,1,2,2,2,1,2,2,2};
+
+__attribute__((target("avx2")))
+static unsigned long butterfly_avx2(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m256d x0, x1, s, d;
+	__m256d zero = _mm256_setzero_pd();
+
+	for (j = 0; j + 2 <= len; j += 2)
+	{
+		x0 = _mm256_loadu_pd((double *) &a0[j]);
+		x1 = _mm256_loadu_pd((double *) &a1[j]);
+		s = _mm256_add_pd(x0, x1);
+		d = _mm256_sub_pd(x0, x1);
+		_mm256_storeu_pd((double *) &a0[j], s);
+		_mm256_storeu_pd((double *) &a1[j], d);
+		live += LivePairs[_mm256_movemask_pd(_mm256_cmp_pd(s, zero, _CMP_NEQ_UQ))];
+		live += LivePairs[_mm256_movemask_pd(_mm256_cmp_pd(d, zero, _CMP_NEQ_UQ))];
+	}
+	if (j < len)
+		live += butterfly_sse2(&a0[j], &a1[j], len - j);
+	_mm256_zeroupper();
+	return live;
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	__m256d x0, x1;
+
+	for (j = 0; j + 2 <= len; j += 2)
+	{
+		x0 = _mm256_loadu_pd((double *) &a0[j]);
+		x1 = _mm256_loadu_pd((double *) &a1[j]);
+		_mm256_storeu_pd((double *) &a0[j], x1);
+		_mm256_storeu_pd((double *) &a1[j], x0);
+	}
+	if (j < len)
+		swap_sse2(&a0[j], &a1[j], len - j);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx2")))
+static void phase_avx2(double complex * a, unsigned long len, double pr, double pi, double div)
+{
+	unsigned long j;
+	__m256d vr = _mm256_set1_pd(pr);
+	__m256d vi = _mm256_set1_pd(pi);
+	__m256d vd = _mm256_set1_pd(div);
+	__m256d x, t1, t2;
+
+	for (j = 0; j + 2 <= len; j += 2)
+	{
+		x = _mm256_loadu_pd((double *) &a[j]);
+		t1 = _mm256_mul_pd(x, vr);
+		t2 = _mm256_mul_pd(_mm256_permute_pd(x, 0x5), vi);
+		x = _mm256_addsub_pd(t1, t2);
+		if (div != 1.0)
+			x = _mm256_div_pd(x, vd);
+		_mm256_storeu_pd((double *) &a[j], x);
+	}
+	if (j < len)
+		phase_sse2(&a[j], len - j, pr, pi, div);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx2")))
+static unsigned long live_avx2(double complex * a, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m256d zero = _mm256_setzero_pd();
+
+	for (j = 0; j + 2 <= len; j += 2)
+		live += LivePairs[_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd((double *) &a[j]), zero, _CMP_NEQ_UQ))];
+	if (j < len)
+		live += live_sse2(&a[j], len - j);
+	_mm256_zeroupper();
+	return live;
+}
+
+/*************** AVX-512, four amplitudes per register ***************/
+
+// one bit per amplitude from the 8 bit compare mask of (re,im) pairs
+#define LIVE_QUADS(m) __builtin_popcount(((m) | ((m) >> 1)) & 0x55)
+
+__attribute__((target("avx512f")))
+static unsigned long butterfly_avx512(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m512d x0, x1, s, d;
+	__m512d zero = _mm512_setzero_pd();
+	unsigned int m;
+
+	for (j = 0; j + 4 <= len; j += 4)
+	{
+		x0 = _mm512_loadu_pd((double *) &a0[j]);
+		x1 = _mm512_loadu_pd((double *) &a1[j]);
+		s = _mm512_add_pd(x0, x1);
+		d = _mm512_sub_pd(x0, x1);
+		_mm512_storeu_pd((double *) &a0[j], s);
+		_mm512_storeu_pd((double *) &a1[j], d);
+		m = _mm512_cmp_pd_mask(s, zero, _CMP_NEQ_UQ);
+		live += LIVE_QUADS(m);
+		m = _mm512_cmp_pd_mask(d, zero, _CMP_NEQ_UQ);
+		live += LIVE_QUADS(m);
+	}
+	if (j < len)
+		live += butterfly_avx2(&a0[j], &a1[j], len - j);
+	_mm256_zeroupper();
+	return live;
+}
+
+__attribute__((target("avx512f")))
+static void swap_avx512(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	__m512d x0, x1;
+
+	for (j = 0; j + 4 <= len; j += 4)
+	{
+		x0 = _mm512_loadu_pd((double *) &a0[j]);
+		x1 = _mm512_loadu_pd((double *) &a1[j]);
+		_mm512_storeu_pd((double *) &a0[j], x1);
+		_mm512_storeu_pd((double *) &a1[j], x0);
+	}
+	if (j < len)
+		swap_avx2(&a0[j], &a1[j], len - j);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+static void phase_avx512(double complex * a, unsigned long len, double pr, double pi, double div)
+{
+	unsigned long j;
+	__m512d vr = _mm512_set1_pd(pr);
+	__m512d vi = _mm512_set1_pd(pi);
+	__m512d vd = _mm512_set1_pd(div);
+	__m512d x, t1, t2;
+
+	for (j = 0; j + 4 <= len; j += 4)
+	{
+		x = _mm512_loadu_pd((double *) &a[j]);
+		t1 = _mm512_mul_pd(x, vr);
+		t2 = _mm512_mul_pd(_mm512_permute_pd(x, 0x55), vi);
+		x = _mm512_mask_sub_pd(_mm512_add_pd(t1, t2), 0x55, t1, t2);  // subtract in the real lanes
+		if (div != 1.0)
+			x = _mm512_div_pd(x, vd);
+		_mm512_storeu_pd((double *) &a[j], x);
+	}
+	if (j < len)
+		phase_avx2(&a[j], len - j, pr, pi, div);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+static unsigned long live_avx512(double complex * a, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+	__m512d zero = _mm512_setzero_pd();
+	unsigned int m;
+
+	for (j = 0; j + 4 <= len; j += 4)
+	{
+		m = _mm512_cmp_pd_mask(_mm512_loadu_pd((double *) &a[j]), zero, _CMP_NEQ_UQ);
+		live += LIVE_QUADS(m);
+	}
+	if (j < len)
+		live += live_avx2(&a[j], len - j);
+	_mm256_zeroupper();
+	return live;
+}
+
+#endif
+
+int qDense_SetSimdLevel(int level)
+{
+	int best = QDENSE_SCALAR;
+
+#ifdef QDENSE_X86
+	__builtin_cpu_init();
+	best = QDENSE_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		best = QDENSE_AVX2;
+	if (__builtin_cpu_supports("avx512f"))
+		best = QDENSE_AVX512;
+#endif
+	if ((level < 0) || (level > best))
+		level = best;
+
+	Kernels.Butterfly = &butterfly_scalar;
+	Kernels.Swap = &swap_scalar;
+	Kernels.Phase = &phase_scalar;
+	Kernels.Live = &live_scalar;
+#ifdef QDENSE_X86
+	if (level == QDENSE_SSE2)
+	{
+		Kernels.Butterfly = &butterfly_sse2;
+		Kernels.Swap = &swap_sse2;
+		Kernels.Phase = &phase_sse2;
+		Kernels.Live = &live_sse2;
+	}
+	else if (level == QDENSE_AVX2)
+	{
+		Kernels.Butterfly = &butterfly_avx2;
+		Kernels.Swap = &swap_avx2;
+		Kernels.Phase = &phase_avx2;
+		Kernels.Live = &live_avx2;
+	}
+	else if (level == QDENSE_AVX512)
+	{
+		Kernels.Butterfly = &butterfly_avx512;
+		Kernels.Swap = &swap_avx512;
+		Kernels.Phase = &phase_avx512;
+		Kernels.Live = &live_avx512;
+	}
+#endif
+	KernelLevel = level;
+	return level;
+}
+
+int qDense_GetSimdLevel(void)
+{
+	if (KernelLevel < 0)
+		qDense_SetSimdLevel(-1);
+	return KernelLevel;
+}
+
+// visits the runs of indices j with (j & fixMask) == setMask. a run is as long as
+// the lowest bit of fixMask, and the enumeration skips every index that fails
+// the condition, so controlled gates only touch the amplitudes they change.
+// with no fixMask the whole array is a single run.
+// large arrays are split into one block of runs per thread, body adds to live
+
+#define QDENSE_PAR_MIN (1UL << 14)
+
+static unsigned long depositBits(unsigned long x, unsigned long mask)
+{
+	unsigned long r = 0;
+
+	// the low bits of x, spread over the set bits of mask
+	while (mask)
+	{
+		if (x & 1)
+			r |= mask & (0 - mask);
+		x >>= 1;
+		mask &= mask - 1;
+	}
+	return r;
+}
+
+#define RUN_LOOP(Size, fixMask, setMask, j, len, pragma, body) \
+  do { \
+    unsigned long len = (fixMask) ? ((fixMask) & (0 - (fixMask))) : (Size); \
+    unsigned long freeMask = ((Size) - 1) & ~(fixMask) & ~(len - 1); \
+    unsigned long runs = 1UL << __builtin_popcountl(freeMask); \
+    long chunks = 1; \
+    long c; \
+    if ((Size) >= QDENSE_PAR_MIN) \
+      chunks = qEmul_GetThreads(); \
+    if (chunks > (long) runs) \
+      chunks = runs; \
+    _Pragma(pragma) \
+    for (c = 0; c < chunks; c++) { \
+      unsigned long r = runs * c / chunks; \
+      unsigned long rEnd = runs * (c + 1) / chunks; \
+      unsigned long sub = depositBits(r, freeMask); \
+      unsigned long j; \
+      for (; r < rEnd; r++) { \
+        j = sub | (setMask); \
+        body; \
+        sub = (sub - freeMask) & freeMask; \
+      } \
+    } \
+  } while (0)
+
+#define FOR_EACH_RUN(Size, fixMask, setMask, j, len, body) \
+  RUN_LOOP(Size, fixMask, setMask, j, len, "omp parallel for schedule(static) num_threads(chunks) if (chunks > 1)", body)
+
+// the same, for bodies that count the live entries into a variable live
+
+#define FOR_EACH_RUN_LIVE(Size, fixMask, setMask, j, len, body) \
+  RUN_LOOP(Size, fixMask, setMask, j, len, "omp parallel for schedule(static) reduction(+:live) num_threads(chunks) if (chunks > 1)", body)
+
+void qDense_H(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long live = 0;
+
+	qStore->Totals = 0;
+	qDense_GetSimdLevel();
+	// runs too short for the vector kernels are done inline
+	if (mask < 4)
+		FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, live += butterfly_scalar(&Amp[j], &Amp[j + mask], len));
+	else
+		FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, live += Kernels.Butterfly(&Amp[j], &Amp[j + mask], len));
+	qStore->Live = live;
+}
+
+void qDense_X(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+
+	qStore->Totals = 0;
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN(Size, mask, 0, j, len, Kernels.Swap(&Amp[j], &Amp[j + mask], len));
+}
+
+void qDense_CN(QStore * qStore, unsigned long cMask, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+
+	qStore->Totals = 0;
+	if (cMask == 0)
+		return;
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN(Size, cMask | mask, cMask, j, len, Kernels.Swap(&Amp[j], &Amp[j + mask], len));
+}
+
+void qDense_CP(QStore * qStore, unsigned long cMask, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+
+	qStore->Totals = 0;
+	// allow for when cMask == 0
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN(Size, cMask | mask, cMask | mask, j, len, Kernels.Phase(&Amp[j], len, cos(PI/2), sin(PI/2), 1.0));
+}
+
+void qDense_CT(QStore * qStore, unsigned long cMask, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+
+	qStore->Totals = 0;
+	// e^{pi/4}, as (1 + i) / sqrt(2) to match qEmul_InsertInList_CT
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN(Size, cMask | mask, cMask | mask, j, len, Kernels.Phase(&Amp[j], len, 1.0, 1.0, sqrt(2.0)));
+}
+
+static unsigned long htRun(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+
+	for (j = 0; j < len; j++)
+	{
+		a0[j] = a0[j] + a1[j];
+		a1[j] = 0;
+		live += (a0[j] != 0);
+	}
+	return live;
+}
+
+static unsigned long hbRun(double complex * a0, double complex * a1, unsigned long len)
+{
+	unsigned long j;
+	unsigned long live = 0;
+
+	for (j = 0; j < len; j++)
+	{
+		a1[j] = a0[j] - a1[j];
+		a0[j] = 0;
+		live += (a1[j] != 0);
+	}
+	return live;
+}
+
+void qDense_Ht(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long live = 0;
+
+	qStore->Totals = 0;
+	FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, live += htRun(&Amp[j], &Amp[j + mask], len));
+	qStore->Live = live;
+}
+
+void qDense_Hb(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long live = 0;
+
+	qStore->Totals = 0;
+	FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, live += hbRun(&Amp[j], &Amp[j + mask], len));
+	qStore->Live = live;
+}
+
+void qDense_0(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long live = 0;
+
+	qStore->Totals = 0;
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, memset(&Amp[j + mask], 0, len * sizeof(double complex)); live += Kernels.Live(&Amp[j], len));
+	qStore->Live = live;
+}
+
+void qDense_1(QStore * qStore, unsigned long mask)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long live = 0;
+
+	qStore->Totals = 0;
+	qDense_GetSimdLevel();
+	FOR_EACH_RUN_LIVE(Size, mask, 0, j, len, memset(&Amp[j], 0, len * sizeof(double complex)); live += Kernels.Live(&Amp[j + mask], len));
+	qStore->Live = live;
+}
+
+static void diagRun(double complex * a, unsigned long j, unsigned long len, QStage * stage, int numStages)
+{
+	unsigned long k;
+	int s;
+
+	for (k = 0; k < len; k++)
+	{
+		for (s = 0; s < numStages; s++)
+		{
+			if (!((j + k) & stage[s].Mask))
+				continue;
+			if (stage[s].Op == QSTAGE_P)
+				a[k] = a[k] * (cos(PI/2) + sin(PI/2)*_Complex_I);
+			else
+				a[k] = a[k] * (1 + _Complex_I) / sqrt(2.0);
+		}
+	}
+}
+
+// applies one branching stage to a block of the array, returns the live count
+// of the block
+
+static unsigned long blockStage(double complex * a, unsigned long blockSize, QStage * stage)
+{
+	unsigned long mask = stage->Mask;
+	unsigned long base;
+	unsigned long live = 0;
+
+	for (base = 0; base < blockSize; base += 2 * mask)
+	{
+		if (stage->Op == QSTAGE_Ht)
+			live += htRun(&a[base], &a[base + mask], mask);
+		else if (stage->Op == QSTAGE_Hb)
+			live += hbRun(&a[base], &a[base + mask], mask);
+		else if (mask < 4)
+			live += butterfly_scalar(&a[base], &a[base + mask], mask);
+		else
+			live += Kernels.Butterfly(&a[base], &a[base + mask], mask);
+	}
+	return live;
+}
+
+// consecutive branching stages on the low qubits are done block by block, each
+// block going through all of them while it is in cache
+
+#define QDENSE_BLOCK (1UL << 12)
+
+static void blockStages(QStore * qStore, QStage * stage, int numStages)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long blockSize = (Size < QDENSE_BLOCK) ? Size : QDENSE_BLOCK;
+	unsigned long live = 0;
+	long b;
+
+	qDense_GetSimdLevel();
+	#pragma omp parallel for schedule(static) reduction(+:live) num_threads(qEmul_GetThreads()) if (Size >= QDENSE_PAR_MIN)
+	for (b = 0; b < (long) (Size / blockSize); b++)
+	{
+		unsigned long blockLive = 0;
+		int s;
+
+		// the last stage writes every amplitude of the block
+		for (s = 0; s < numStages; s++)
+			blockLive = blockStage(&Amp[b * blockSize], blockSize, &stage[s]);
+		live += blockLive;
+	}
+	qStore->Live = live;
+}
+
+// a compiled column: the butterflies in place one qubit at a time, runs of
+// phases merged into one pass, and the X/N relabelling as one swap pass
+
+void qDense_Column(QStore * qStore, QColumn * qCol)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long cMask = qCol->cMask;
+	long v;
+	int s, e;
+
+	qStore->Totals = 0;
+	for (s = 0; s < qCol->numStages; s = e)
+	{
+		QStage * stage = &(qCol->Stage[s]);
+
+		e = s + 1;
+		if (stage->Op < QSTAGE_P)
+		{
+			if (stage->Mask < QDENSE_BLOCK)
+			{
+				while ((e < qCol->numStages) && (qCol->Stage[e].Op < QSTAGE_P) && (qCol->Stage[e].Mask < QDENSE_BLOCK))
+					e++;
+			}
+			if (e > s + 1)
+				blockStages(qStore, stage, e - s);
+			else if (stage->Op == QSTAGE_H)
+				qDense_H(qStore, stage->Mask);
+			else if (stage->Op == QSTAGE_Ht)
+				qDense_Ht(qStore, stage->Mask);
+			else
+				qDense_Hb(qStore, stage->Mask);
+		}
+		else
+		{
+			while ((e < qCol->numStages) && (qCol->Stage[e].Op >= QSTAGE_P))
+				e++;
+			if ((e == s + 1) && (stage->Op == QSTAGE_P))
+				qDense_CP(qStore, cMask, stage->Mask);
+			else if (e == s + 1)
+				qDense_CT(qStore, cMask, stage->Mask);
+			else
+				FOR_EACH_RUN(Size, cMask, cMask, j, len, diagRun(&Amp[j], j, len, stage, e - s));
+		}
+	}
+
+	if ((qCol->xMask == 0) && (qCol->nMask == 0))
+		return;
+	#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads()) if (Size >= QDENSE_PAR_MIN)
+	for (v = 0; v < (long) Size; v++)
+	{
+		unsigned long w = v ^ qCol->xMask;
+		double complex a0;
+
+		if ((cMask != 0) && ((v & cMask) == cMask))
+			w ^= qCol->nMask;
+		if (w > (unsigned long) v)
+		{
+			a0 = Amp[v];
+			Amp[v] = Amp[w];
+			Amp[w] = a0;
+		}
+	}
+}
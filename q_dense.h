@@ -0,0 +1,61 @@
+/******************************************
+ * Name: q_dense.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#ifndef Q_DENSE_H
+#define Q_DENSE_H
+
+#include "q_state.h"
+#include "q_column.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// in-place gate kernels for a dense QStore. they give the same results as the
+// matching qEmul_InsertInList_* applied to every entry
+
+// the kernels use the widest SIMD level the CPU supports, picked on first use.
+// qDense_SetSimdLevel can lower it (-1 selects the best again) and returns
+// the level actually chosen
+
+#define QDENSE_SCALAR 0
+#define QDENSE_SSE2 1
+#define QDENSE_AVX2 2
+#define QDENSE_AVX512 3
+
+int qDense_SetSimdLevel(int level);
+int qDense_GetSimdLevel(void);
+
+void qDense_H(QStore * qStore, unsigned long mask);
+void qDense_X(QStore * qStore, unsigned long mask);
+void qDense_CN(QStore * qStore, unsigned long cMask, unsigned long mask);
+void qDense_CP(QStore * qStore, unsigned long cMask, unsigned long mask);
+void qDense_CT(QStore * qStore, unsigned long cMask, unsigned long mask);
+void qDense_Ht(QStore * qStore, unsigned long mask);
+void qDense_Hb(QStore * qStore, unsigned long mask);
+void qDense_0(QStore * qStore, unsigned long mask);
+void qDense_1(QStore * qStore, unsigned long mask);
+void qDense_Column(QStore * qStore, QColumn * qCol);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
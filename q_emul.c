@@ -25,9 +25,14 @@
 #include <sys/time.h>
 #include <math.h>
 #include "q_emul.h"
+#include "q_dense.h"
+#include "q_column.h"
+#include "q_sort.h"
+#include "q_cache.h"
 #include "omp.h"
 
 static double Probability = 1.0;
+static int Threads = 0; // 0 lets OpenMP decide
 #define PI (2 * acos(0.0))
 
 double qEmul_GetProbability(void)
@@ -45,6 +50,18 @@ int qEmul_Version(void)
 	return Q_VERSION;
 }
 
+void qEmul_SetThreads(int numThreads)
+{
+	Threads = (numThreads > 0) ? numThreads : 0;
+}
+
+int qEmul_GetThreads(void)
+{
+	if (Threads > 0)
+		return Threads;
+	return omp_get_max_threads();
+}
+
 double complex qEmul_Count2List(QState * qList)
 {
         QState * tempPtr;
@@ -152,7 +169,18 @@ int qEmul_PrintList(int numQubits, QState * qList, char * outStr, int outStrLen)
 	return 0;
 } 
 
+// lists made by qEmul are a single arena block, any other list is taken to
+// be one malloc per node
+
 void qEmul_FreeList(QState * qList)
+{
+	if (qList && !qState_ListFree(qList))
+		qEmul_FreeMallocList(qList);
+}
+
+// for lists a caller has put together itself, one malloc per node
+
+void qEmul_FreeMallocList(QState * qList)
 {
 	QState * temp;
 
@@ -164,16 +192,35 @@ void qEmul_FreeList(QState * qList)
 	}
 }
 
-void qEmul_CreateList(QState ** qList)
+// a copy of qList in one block, for runs that go on from the same state
+
+void qEmul_CopyList(QState * qList, QState ** copy)
 {
-	QState *temp;
-	temp = malloc(sizeof(QState));
+	QState * currPtr, * newList;
+	unsigned long count = 0, i;
 
-	if (!temp)
+	for (currPtr = qList; currPtr; currPtr = currPtr->next)
+		count++;
+	if (count == 0)
 	{
-		fprintf(stderr,"Error in malloc qList\n");
-		exit(-1);
+		*copy = NULL;
+		return;
 	}
+	newList = qState_ListAlloc(count);
+	for (i = 0, currPtr = qList; i < count; i++, currPtr = currPtr->next)
+	{
+		newList[i].Value = currPtr->Value;
+		newList[i].Count = currPtr->Count;
+		newList[i].next = (i + 1 < count) ? &newList[i+1] : NULL;
+	}
+	*copy = newList;
+}
+
+void qEmul_CreateList(QState ** qList)
+{
+	QState *temp;
+	temp = qState_ListAlloc(1);
+
 	temp->Value = 0;
 	temp->Count = 1.0;
 	temp->next = NULL; 
@@ -183,73 +230,23 @@ void qEmul_CreateList(QState ** qList)
 	qOracle_setup();
 }
 
-static void InsertInList(QState * newState, QState ** qList)
+static void InsertInHash(QState * newState, QHash * qHash)
 {
-	QState * temp;
-	QState * tmpPtr, * prevPtr;
-
 	if (!newState)
 		return;
 
-	if (!*qList)
-	{
-		*qList = malloc(sizeof(QState));
-		if (!*qList)
-		{
-			fprintf(stderr,"Error: unable to malloc \n");
-			exit(-1);
-		}
-		memcpy(*qList,newState,sizeof(QState));
-	}
-	else
-	{
-		prevPtr = NULL;
-		tmpPtr = *qList;
-		while ((tmpPtr) && (tmpPtr->Value < newState->Value))
-		{
-			prevPtr = tmpPtr;
-			tmpPtr = tmpPtr->next;
-		}
-		if ((!tmpPtr) || (tmpPtr->Value != newState->Value))
-		{
-			temp = malloc(sizeof(QState));
-			if (!temp)
-			{
-				fprintf(stderr,"Error: unable to malloc\n");
-				exit(-1);
-			}
-			memcpy(temp,newState,sizeof(QState));
-			if (prevPtr == NULL) // need to replace the first in list
-			{
-				temp->next = *qList;
-				*qList = temp;
-			}
-			else
-			{
-				temp->next = prevPtr->next;
-				prevPtr->next = temp;
-			}
-		}
-		else
-		{
-			tmpPtr->Count += newState->Count;
-			if ((creal(tmpPtr->Count) == 0) && (cimag(tmpPtr->Count)==0))
-			{
-				if (prevPtr == NULL)
-				{
-					*qList = tmpPtr->next;
-				}
-				else	
-					prevPtr->next = tmpPtr->next;
-				free(tmpPtr);
-			}
-		}
+	qState_HashAdd(qHash,newState->Value,newState->Count);
+}
 
-	} 
+static void InsertInStore(QState * newState, QStore * qStore)
+{
+	if (!newState)
+		return;
 
+	qState_StoreAdd(qStore,newState->Value,newState->Count);
 }
 
-void qEmul_InsertInList_H(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_H(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -262,23 +259,23 @@ void qEmul_InsertInList_H(unsigned long mask,QState * currState, QState ** qList
 	{
 		tempState.Value = currState->Value - mask;
 		tempState.Count = currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 		tempState.Value = currState->Value;
 		tempState.Count = 0 - currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 	}
 	else
 	{
 		tempState.Value = currState->Value;
 		tempState.Count = currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 		tempState.Value = currState->Value + mask;
 		tempState.Count = currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 	}
 }
 
-void qEmul_InsertInList_CT(unsigned long cMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_CT(unsigned long cMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -306,10 +303,10 @@ void qEmul_InsertInList_CT(unsigned long cMask, unsigned long mask,QState * curr
 		tempState.Count = currState->Count;
 	}
 	
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_CP(unsigned long cMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_CP(unsigned long cMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -337,10 +334,10 @@ void qEmul_InsertInList_CP(unsigned long cMask, unsigned long mask,QState * curr
 		tempState.Count = currState->Count;
 	}
 	
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
  
-void qEmul_InsertInList_Ht(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_Ht(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -356,10 +353,10 @@ void qEmul_InsertInList_Ht(unsigned long mask,QState * currState, QState ** qLis
 	else
 		tempState.Value = currState->Value;
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_Hb(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_Hb(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -378,10 +375,10 @@ void qEmul_InsertInList_Hb(unsigned long mask,QState * currState, QState ** qLis
 		tempState.Value = currState->Value + mask;
 		tempState.Count = currState->Count;
 	}
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_X(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_X(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -397,10 +394,10 @@ void qEmul_InsertInList_X(unsigned long mask,QState * currState, QState ** qList
 	else
 		tempState.Value = currState->Value + mask;
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_c(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_c(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 	unsigned long tempVal;
@@ -431,10 +428,10 @@ void qEmul_InsertInList_c(unsigned long mask,QState * currState, QState ** qList
 	}
 
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_d(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_d(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 	unsigned long tempVal;
@@ -461,10 +458,10 @@ void qEmul_InsertInList_d(unsigned long mask,QState * currState, QState ** qList
 	}
 
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_I(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_I(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -475,10 +472,10 @@ void qEmul_InsertInList_I(unsigned long mask,QState * currState, QState ** qList
 
 	tempState.Value = currState->Value;
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_0(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_0(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -491,11 +488,11 @@ void qEmul_InsertInList_0(unsigned long mask,QState * currState, QState ** qList
 	{
 		tempState.Value = currState->Value;
 		tempState.Count = currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 	}
 }
 
-void qEmul_InsertInList_1(unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_1(unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -508,11 +505,11 @@ void qEmul_InsertInList_1(unsigned long mask,QState * currState, QState ** qList
 	{
 		tempState.Value = currState->Value;
 		tempState.Count = currState->Count;
-		InsertInList(&tempState,qList);
+		InsertInStore(&tempState,qStore);
 	}
 }
 
-void qEmul_InsertInList_CN(unsigned long cMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_CN(unsigned long cMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -531,10 +528,10 @@ void qEmul_InsertInList_CN(unsigned long cMask, unsigned long mask,QState * curr
 	else
 		tempState.Value = currState->Value;
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-void qEmul_InsertInList_INVQFT(unsigned long qftMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_INVQFT(unsigned long qftMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 	QState tempState1;
@@ -591,12 +588,12 @@ void qEmul_InsertInList_INVQFT(unsigned long qftMask, unsigned long mask,QState
 	}
 
  //printf("QFT value %ld %f %f, %ld %f %f\n",tempState1.Value,creal(tempState1.Count),cimag(tempState1.Count),tempState2.Value,creal(tempState2.Count),cimag(tempState2.Count)); 
-	InsertInList(&tempState1,qList);
-	InsertInList(&tempState2,qList);
+	InsertInStore(&tempState1,qStore);
+	InsertInStore(&tempState2,qStore);
 
 }
 
-void qEmul_InsertInList_QFT(unsigned long qftMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_QFT(unsigned long qftMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState1;
 	QState tempState2;
@@ -651,11 +648,11 @@ void qEmul_InsertInList_QFT(unsigned long qftMask, unsigned long mask,QState * c
 	}	
 
  //printf("QFT value %ld %f %f, %ld %f %f\n",tempState1.Value,creal(tempState1.Count),cimag(tempState1.Count),tempState2.Value,creal(tempState2.Count),cimag(tempState2.Count)); 
-	InsertInList(&tempState1,qList);
-	InsertInList(&tempState2,qList);
+	InsertInStore(&tempState1,qStore);
+	InsertInStore(&tempState2,qStore);
 }
 
-void qEmul_InsertInList_swap(unsigned long swapMask, unsigned long mask,QState * currState, QState ** qList)
+void qEmul_InsertInList_swap(unsigned long swapMask, unsigned long mask,QState * currState, QStore * qStore)
 {
 	QState tempState;
 
@@ -688,7 +685,7 @@ void qEmul_InsertInList_swap(unsigned long swapMask, unsigned long mask,QState *
 
 	}
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
 static unsigned long putValueToMask(unsigned long mask, unsigned long value)
@@ -733,7 +730,7 @@ static unsigned long getValueFromMask(unsigned long mask, unsigned long value)
 	return retValue;
 }
 
-void qEmul_InsertInList_oracle(unsigned long nMask, unsigned long addMask, unsigned long subMask, unsigned long mulMask, unsigned long divMask, unsigned long modMask, unsigned long powMask, unsigned long resMask, QState * currState, QState ** qList)
+void qEmul_InsertInList_oracle(unsigned long nMask, unsigned long addMask, unsigned long subMask, unsigned long mulMask, unsigned long divMask, unsigned long modMask, unsigned long powMask, unsigned long resMask, QState * currState, QStore * qStore)
 {
 	QState tempState;
 	unsigned long aValue = 0;
@@ -808,40 +805,202 @@ void qEmul_InsertInList_oracle(unsigned long nMask, unsigned long addMask, unsig
 	tempState.Value = currState->Value ^ resValue; // doing a XOR instead of =
 
 	tempState.Count = currState->Count;
-	InsertInList(&tempState,qList);
+	InsertInStore(&tempState,qStore);
 }
 
-// To call external oracle
+static void newStep(QStore * curr, QStore * next, int numQubits)
+{
+	// a dense state stays dense across a generic gate
+	qState_StoreInit(next,numQubits,qState_StoreLive(curr) * 2,curr->Dense);
+}
 
-int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long*), char * oracleParams, QState ** qList)
+// one gate of a column, applied to every entry of the state by runStep
+
+#define STEP_H      0
+#define STEP_X      1
+#define STEP_CP     2
+#define STEP_CT     3
+#define STEP_CN     4
+#define STEP_Ht     5
+#define STEP_Hb     6
+#define STEP_0      7
+#define STEP_1      8
+#define STEP_SWAP   9
+#define STEP_DELETE 10
+#define STEP_CLONE  11
+#define STEP_ORACLE 12
+#define STEP_QFT    13
+#define STEP_INVQFT 14
+#define STEP_COLUMN 15
+
+typedef struct _QStep
+{
+	int Gate;
+	unsigned long Mask;
+	unsigned long cMask;      // control, swap or QFT qubits
+	unsigned long Touch;      // bits of Value the gate may change
+	unsigned long Oracle[8];  // n + - * / % ^ = masks
+	QColumn * Column;         // compiled pass
+} QStep;
+
+static void stepEntry(QStep * step, QState * entry, QStore * next)
+{
+	unsigned long * o = step->Oracle;
+
+	switch (step->Gate)
+	{
+		case STEP_H: qEmul_InsertInList_H(step->Mask, entry, next); break;
+		case STEP_X: qEmul_InsertInList_X(step->Mask, entry, next); break;
+		case STEP_CP: qEmul_InsertInList_CP(step->cMask, step->Mask, entry, next); break;
+		case STEP_CT: qEmul_InsertInList_CT(step->cMask, step->Mask, entry, next); break;
+		case STEP_CN: qEmul_InsertInList_CN(step->cMask, step->Mask, entry, next); break;
+		case STEP_Ht: qEmul_InsertInList_Ht(step->Mask, entry, next); break;
+		case STEP_Hb: qEmul_InsertInList_Hb(step->Mask, entry, next); break;
+		case STEP_0: qEmul_InsertInList_0(step->Mask, entry, next); break;
+		case STEP_1: qEmul_InsertInList_1(step->Mask, entry, next); break;
+		case STEP_SWAP: qEmul_InsertInList_swap(step->cMask, step->Mask, entry, next); break;
+		case STEP_DELETE: qEmul_InsertInList_d(step->Mask, entry, next); break;
+		case STEP_CLONE: qEmul_InsertInList_c(step->Mask, entry, next); break;
+		case STEP_ORACLE: qEmul_InsertInList_oracle(o[0],o[1],o[2],o[3],o[4],o[5],o[6],o[7], entry, next); break;
+		case STEP_QFT: qEmul_InsertInList_QFT(step->cMask, step->Mask, entry, next); break;
+		case STEP_INVQFT: qEmul_InsertInList_INVQFT(step->cMask, step->Mask, entry, next); break;
+	}
+}
+
+// gates that do not read curr while writing next emit into a sorted store.
+// the entries are split into contiguous chunks in order, so the emit buffers
+// taken in thread order hold the outputs in the same order as one thread would.
+// hash tables are sorted first, so that the shares of an output are added up
+// in the Value order of their sources, as the linked list did
+
+static void emitStep(QStore * curr, QStore * next, int numQubits, QStep * step)
+{
+	long i;
+
+	qState_StoreMakeSorted(curr);
+	qState_StoreInitSorted(next,numQubits,qState_StoreLive(curr) * 2);
+	#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads()) if (curr->Live >= QSORT_PAR_MIN)
+	for (i = 0; i < (long) curr->Live; i++)
+	{
+		QState tempState;
+
+		if (curr->Amp[i] == 0)
+			continue;
+		tempState.Value = curr->Key[i];
+		tempState.Count = curr->Amp[i];
+		tempState.next = NULL;
+		if (step->Gate == STEP_COLUMN)
+			qColumn_Emit(step->Column,&tempState,next);
+		else
+			stepEntry(step,&tempState,next);
+	}
+	qState_StoreSettle(next);
+}
+
+// builds next from curr. a sharded state is spread over the threads: each one
+// reads a group of shards that only differ in the bits the gate touches, and
+// so is the only writer of the same shards of next. a compiled column also
+// takes the coset members it reads out of curr
+
+static void runStep(QStore * curr, QStore * next, int numQubits, QStep * step)
+{
+	QState entry;
+	unsigned long pos = 0;
+	unsigned long group;
+	int numShards = 1 << curr->ShardBits;
+	int g;
+
+	if (curr->Dense)
+	{
+		newStep(curr,next,numQubits);
+		while (qState_StoreNext(curr,&pos,&entry))
+			stepEntry(step,&entry,next);
+		return;
+	}
+	if ((step->Gate != STEP_COLUMN) || curr->Sorted)
+	{
+		emitStep(curr,next,numQubits,step);
+		return;
+	}
+	qState_StoreInitShards(next,numQubits,qState_StoreLive(curr) * 2,curr->ShardBits);
+	group = (step->Touch >> curr->ShardShift) & (numShards - 1);
+
+	#pragma omp parallel for schedule(dynamic) num_threads(qEmul_GetThreads()) if (numShards > 1)
+	for (g = 0; g < numShards; g++)
+	{
+		QState tempState;
+		QHash * qHash;
+		unsigned long i, sub = 0;
+
+		if (g & group)
+			continue;  // part of the group of g & ~group
+		do
+		{
+			qHash = &(curr->Hash[g | sub]);
+			for (i = 0; i < qHash->Size; i++)
+			{
+				if (!QHASH_LIVE(qHash,i))
+					continue;
+				tempState.Value = qHash->Key[i];
+				tempState.Count = qHash->Amp[i];
+				tempState.next = NULL;
+				if (step->Gate == STEP_COLUMN)
+					qColumn_Coset(step->Column,curr,&tempState,next);
+				else
+					stepEntry(step,&tempState,next);
+			}
+			sub = (sub - group) & group;
+		} while (sub != 0);
+	}
+}
+
+// reads the numbers in params into args, up to maxArgs of them, and returns
+// how many there were. params is used up
+
+int qEmul_ParseParams(char * params, unsigned long * args, int maxArgs)
 {
-	QState * currPtr, * newList;
-	unsigned long oracleArg[127]; // we don't expect the oracle to take in more than 127 arguments
 	unsigned long tempLong;
 	char tempStr[10000];
-	int i,count;
-
-	memset(oracleArg,0,sizeof(oracleArg));
-	for (i=0;i<127;i++)
-		oracleArg[i] = 0;
-	oracleArg[0] = numYQubits;
+	int i = 0;
 
-	i = 2;
-	while ((strlen(oracleParams) > 0) && (i<127))
+	while ((strlen(params) > 0) && (i<maxArgs))
 	{
 		memset(tempStr,0,sizeof(tempStr));
-		sscanf(oracleParams,"%lu %[^\n]",&tempLong,tempStr);
-		strcpy(oracleParams,tempStr);
-		oracleArg[i++] = tempLong;
-		
+		sscanf(params,"%lu %[^\n]",&tempLong,tempStr);
+		strcpy(params,tempStr);
+		args[i++] = tempLong;
 	}
+	return i;
+}
+
+// To call external oracle
+
+int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long*), void * (*Prepare)(unsigned long *), void (*Evaluate)(void *, unsigned long *, unsigned long *, unsigned long), char * oracleParams, QState ** qList)
+{
+	unsigned long oracleArg[MAX_PARAMS]; // we don't expect the oracle to take in more than 127 arguments
+
+	memset(oracleArg,0,sizeof(oracleArg));
+	qEmul_ParseParams(oracleParams,&oracleArg[2],MAX_PARAMS-2);
+	return qEmul_oracleArgs(numYQubits,Oracle,Prepare,Evaluate,oracleArg,qList);
+}
+
+// same, with the parameters already parsed into oracleArg[2] onwards.
+// oracleArg has MAX_PARAMS entries
+
+int qEmul_oracleArgs(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long*), void * (*Prepare)(unsigned long *), void (*Evaluate)(void *, unsigned long *, unsigned long *, unsigned long), unsigned long * oracleArg, QState ** qList)
+{
+	QState * currPtr, * newList;
+	QState ** entries;
+	QStore next;
+	unsigned long tempLong;
+	int i,count;
+
+	oracleArg[0] = numYQubits;
 	currPtr = *qList;
 	if (!currPtr)
 	{
 		return -1;
 	}
-	newList = NULL;
-
 	count = 0;
 	while (currPtr != NULL)
 	{
@@ -849,28 +1008,114 @@ int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long*
 		currPtr=currPtr->next;
 	}
 
-//	omp_set_num_threads(8);
-	#pragma omp parallel for
-	for(i=0;i<count;i++)
+	// index the list so each thread can go straight to its entries, and let
+	// every thread emit into its own buffer of a sorted store
+	entries = (QState **) qArena_Alloc(count * sizeof(QState *));
+	if (!entries)
 	{
-		QState tempState;
-		int j;
-		unsigned long tempArg[127]; // we don't expect the oracle to take in more than 127 arguments
-		QState* tempPtr = *qList;
-		for (j=0;j<i;j++)
-			tempPtr = tempPtr->next;
-		memcpy(tempArg,oracleArg,sizeof(tempArg));
-		
-		tempArg[1] = tempPtr->Value;	
-		tempState.Value = Oracle(tempArg);
-		tempState.Count = tempPtr->Count;
-		tempState.next = NULL;
+		fprintf(stderr,"error: unable to malloc oracle entries\n");
+		exit(-1);
+	}
+	for (i = 0, currPtr = *qList; i < count; i++, currPtr = currPtr->next)
+		entries[i] = currPtr;
+	qState_StoreInitSorted(&next,8 * sizeof(unsigned long),count);
+
+	if (Prepare && Evaluate)
+	{
+		// the parameters are parsed once. the result only depends on the X
+		// register, so equal X share one evaluation, and X seen in earlier
+		// calls with the same parameters come from the oracle cache. oracles
+		// may share Evaluate, each one has its own Prepare to key the cache on
+		void * context = Prepare(oracleArg);
+		struct _QCacheSpace * space = qCache_Open((unsigned long) Prepare,oracleArg,MAX_PARAMS);
+		unsigned long yMask = numYQubits ? (0xFFFFFFFFFFFFFFFF >> ((sizeof(unsigned long)*8)-numYQubits)) : 0;
+		unsigned long * slot, * inputs, * results, * found, * misses;
+		unsigned long numInputs = 0, numMisses = 0, u;
+
+		slot = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+		inputs = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+		results = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+		found = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+		misses = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+		if (!slot || !inputs || !results || !found || !misses)
+		{
+			fprintf(stderr,"error: unable to malloc oracle entries\n");
+			exit(-1);
+		}
+
+		// the list is in Value order, so equal X are next to each other
+		for (i = 0; i < count; i++)
+		{
+			tempLong = entries[i]->Value >> numYQubits;
+			if ((numInputs == 0) || (inputs[numInputs-1] != tempLong))
+				inputs[numInputs++] = tempLong;
+			slot[i] = numInputs-1;
+		}
+		qCache_CountDuplicates(count - numInputs);
+
+		#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads())
+		for (u = 0; u < numInputs; u++)
+			found[u] = qCache_Find(space,inputs[u],&results[u]);
+		for (u = 0; u < numInputs; u++)
+		{
+			if (found[u] == QCACHE_MISS)
+				misses[numMisses++] = u;
+		}
+
+		#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads())
+		for (u = 0; u < numMisses; u += ORACLE_BATCH)
+		{
+			unsigned long values[ORACLE_BATCH], rets[ORACLE_BATCH];
+			unsigned long j, num = (numMisses - u < ORACLE_BATCH) ? numMisses - u : ORACLE_BATCH;
+
+			for (j = 0; j < num; j++)
+				values[j] = inputs[misses[u+j]];
+			Evaluate(context,values,rets,num);
+			for (j = 0; j < num; j++)
+				results[misses[u+j]] = rets[j];
+		}
+
+		// the hits are touched before any miss is stored, as storing can
+		// evict and reuse their entries
+		for (u = 0; u < numInputs; u++)
+		{
+			if (found[u] != QCACHE_MISS)
+				qCache_Use(space,found[u]);
+		}
+		for (u = 0; u < numMisses; u++)
+			qCache_Put(space,inputs[misses[u]],results[misses[u]]);
 
-		#pragma omp critical
-		InsertInList(&tempState,&newList);
+		#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads())
+		for(i=0;i<count;i++)
+		{
+			unsigned long Value = entries[i]->Value;
+
+			qState_StoreAdd(&next,(results[slot[i]] ^ (Value & yMask)) + (Value & ~yMask),entries[i]->Count);
+		}
+		qArena_Free(misses);
+		qArena_Free(found);
+		qArena_Free(results);
+		qArena_Free(inputs);
+		qArena_Free(slot);
+		qOracle_Release(context);
+	}
+	else
+	{
+		#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads())
+		for(i=0;i<count;i++)
+		{
+			unsigned long tempArg[MAX_PARAMS];
 
+			memcpy(tempArg,oracleArg,sizeof(tempArg));
+			tempArg[1] = entries[i]->Value;	
+			qState_StoreAdd(&next,Oracle(tempArg),entries[i]->Count);
+		}
 	}
+	qArena_Free(entries);
 
+	qState_StoreSettle(&next);
+	qState_StoreToList(&next,&newList);
+	qState_StoreFree(&next);
 	qEmul_FreeList(*qList);
 	*qList = newList;
 	return 0;
@@ -879,31 +1124,42 @@ int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long*
 
 // to call a classical function
 
-int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long*), char * functionParams, QState ** qList)
+int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long*), void (*Direct)(int, unsigned long *, QState *, QHash *), char * functionParams, QState ** qList)
+{
+	unsigned long functionArg[MAX_PARAMS]; // we don't expect the function to take in more than 127 arguments
+
+	memset(functionArg,0,sizeof(functionArg));
+	qEmul_ParseParams(functionParams,functionArg,MAX_PARAMS);
+	return qEmul_functionArgs(numBits,Function,Direct,functionArg,qList);
+}
+
+// same, with the parameters already parsed into functionArg
+
+int qEmul_functionArgs(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long*), void (*Direct)(int, unsigned long *, QState *, QHash *), unsigned long * functionArg, QState ** qList)
 {
 	QState * currPtr, * newList;
 	QState tempState;
-	unsigned long functionArg[127]; // we don't expect the function to take in more than 127 arguments
+	QHash newHash;
 	unsigned long tempLong;
-	char tempStr[10000];
 	int i;
 	unsigned long * qubitValues, *newQubitValues;
 
-	memset(functionArg,0,sizeof(functionArg));
-	i = 0;
-	while ((strlen(functionParams) > 0) && (i<127))
-	{
-		memset(tempStr,0,sizeof(tempStr));
-		sscanf(functionParams,"%lu %[^\n]",&tempLong,tempStr);
-		strcpy(functionParams,tempStr);
-		functionArg[i++] = tempLong;
-		
-	}
 	currPtr = *qList;
 	if (!currPtr)
 	{
 		return -1;
 	}
+
+	if (Direct)
+	{
+		qState_HashInit(&newHash,0);
+		Direct(numBits, functionArg, *qList, &newHash);
+		qState_HashToList(&newHash,&newList);
+		qState_HashFree(&newHash);
+		qEmul_FreeList(*qList);
+		*qList = newList;
+		return 0;
+	}
 	
 	tempLong = 1;
 	while (currPtr != NULL)
@@ -932,7 +1188,7 @@ int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsign
 	}
 
 	newQubitValues = Function(numBits, functionArg, qubitValues); 
-	newList = NULL;
+	qState_HashInit(&newHash,0);
 
 	if (newQubitValues) // there is no free here, so newQubitValues is likely to be re-using the space allocated by qubitValues 
 	{
@@ -941,9 +1197,11 @@ int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsign
 			tempState.Value = newQubitValues[i+1] ;
 			tempState.Count = 1.0;
 			tempState.next = NULL;
-			InsertInList(&tempState,&newList);
+			InsertInHash(&tempState,&newHash);
 		}
 	}
+	qState_HashToList(&newHash,&newList);
+	qState_HashFree(&newHash);
 	free(qubitValues);
 	qEmul_FreeList(*qList);
 	*qList = newList;
@@ -951,6 +1209,130 @@ int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsign
 	
 }
 
+// counter based random numbers, so each shot gets its own whatever thread
+// draws it
+
+static unsigned long splitMix(unsigned long x)
+{
+	x += 0x9E3779B97F4A7C15;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+	return x ^ (x >> 31);
+}
+
+// the weight of an entry when sampling, |Count|^2, or |re|+|im| as the m gate
+// picks
+
+static double sampleWeight(double complex Count, int measure)
+{
+	if (measure)
+		return fabs(creal(Count)) + fabs(cimag(Count));
+	return creal(Count) * creal(Count) + cimag(Count) * cimag(Count);
+}
+
+// draws shots measurements of the qubits in qubitMask, each out[] value being
+// the Value of an entry & qubitMask. a Walker/Vose alias table over the
+// entries is built once, after which a shot is one uniform draw and one
+// compare. the stream is seeded from rand() and shot n always gets the n-th
+// number of it, so the threads do not change the outcome
+
+static int sampleList(QState * qList, unsigned long qubitMask, unsigned long shots, unsigned long * out, int measure)
+{
+	QState * currPtr;
+	unsigned long * values, * alias, * work;
+	double * prob;
+	double total = 0;
+	unsigned long count = 0, i, small, large, numSmall, numLarge;
+	unsigned long seed;
+
+	for (currPtr = qList; currPtr; currPtr = currPtr->next)
+	{
+		total += sampleWeight(currPtr->Count,measure);
+		count++;
+	}
+	if ((count == 0) || (total <= 0))
+		return -1;
+
+	values = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+	alias = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+	work = (unsigned long *) qArena_Alloc(count * sizeof(unsigned long));
+	prob = (double *) qArena_Alloc(count * sizeof(double));
+	if (!values || !alias || !work || !prob)
+	{
+		fprintf(stderr,"error: unable to malloc alias table\n");
+		exit(-1);
+	}
+
+	// scaled so the average entry has 1. the ones below 1 are stacked from
+	// the front of work and the others from the back
+	numSmall = numLarge = 0;
+	for (i = 0, currPtr = qList; i < count; i++, currPtr = currPtr->next)
+	{
+		values[i] = currPtr->Value & qubitMask;
+		alias[i] = i;
+		prob[i] = sampleWeight(currPtr->Count,measure) * count / total;
+		if (prob[i] < 1.0)
+			work[numSmall++] = i;
+		else
+			work[count - 1 - numLarge++] = i;
+	}
+
+	// each small entry is topped up to 1 by a large one, which then goes
+	// onto the small stack once it is below 1 itself
+	while ((numSmall > 0) && (numLarge > 0))
+	{
+		small = work[--numSmall];
+		large = work[count - numLarge];
+		alias[small] = large;
+		prob[large] -= 1.0 - prob[small];
+		if (prob[large] < 1.0)
+		{
+			numLarge--;
+			work[numSmall++] = large;
+		}
+	}
+	// what is left is 1 up to rounding
+	while (numSmall > 0)
+		prob[work[--numSmall]] = 1.0;
+	while (numLarge > 0)
+		prob[work[count - numLarge--]] = 1.0;
+
+	seed = ((unsigned long) rand() << 31) ^ (unsigned long) rand();
+
+	#pragma omp parallel for schedule(static) num_threads(qEmul_GetThreads())
+	for (i = 0; i < shots; i++)
+	{
+		unsigned long r = splitMix(seed + i * 0x9E3779B97F4A7C15);
+		double u = (double) (r >> 11) * (1.0 / 9007199254740992.0) * count;  // [0, count)
+		unsigned long k = (unsigned long) u;
+
+		if (k >= count)
+			k = count - 1;
+		out[i] = values[(u - k < prob[k]) ? k : alias[k]];
+	}
+
+	qArena_Free(prob);
+	qArena_Free(work);
+	qArena_Free(alias);
+	qArena_Free(values);
+	return 0;
+}
+
+// entries are picked with weight |Count|^2
+
+int qEmul_Sample(QState * qList, unsigned long qubitMask, unsigned long shots, unsigned long * out)
+{
+	return sampleList(qList,qubitMask,shots,out,0);
+}
+
+// entries are picked with weight |re|+|im|, as the m gate does, so the shots
+// come out as often as the outcomes of as many runs measuring the qubits
+
+int qEmul_SampleMeasure(QState * qList, unsigned long qubitMask, unsigned long shots, unsigned long * out)
+{
+	return sampleList(qList,qubitMask,shots,out,1);
+}
+
 int qEmul_Write(int numQubits, char * fileName, QState * qList)
 {
 	QState * currPtr = qList;
@@ -984,6 +1366,7 @@ int qEmul_Write(int numQubits, char * fileName, QState * qList)
 int qEmul_Read(int numQubits, char * fileName, QState ** qList)
 {
 	QState tempState;
+	QHash qHash;
 	FILE * f;
 
 	f = fopen(fileName,"rb");
@@ -992,188 +1375,135 @@ int qEmul_Read(int numQubits, char * fileName, QState ** qList)
 		fprintf(stderr,"unable to open %s for reading\n",fileName);
 		return -1;	
 	}
+	qState_HashFromList(&qHash,*qList); // read entries are added to the current state
 	while (!feof(f))
 	{
 		if (fread(&tempState,sizeof(QState),1,f) == 1) 
 		{
 			tempState.next = NULL;
-			InsertInList(&tempState,qList);
+			InsertInHash(&tempState,&qHash);
 		}			
 	}
 	fclose(f);
+	qEmul_FreeList(*qList);
+	qState_HashToList(&qHash,qList);
+	qState_HashFree(&qHash);
 	return 0;
 }
 
 
 int qEmul_exec(int numQubits, char * qAlgo, QState ** qList)
 {
-	QState * currPtr, * newList;
+	QState * newList;
+	QStore curr, next;
+	QStep step;
+	QColumn column;
+	QColumnDesc desc;
 	unsigned long mask;
-	int i;
+	unsigned long estimate = 0;
+	int i, end;
+	int inPlace;
 	int oracleDone = 0;
 	int swapDone = 0;
 	int retQubits = numQubits;
 
-	currPtr = *qList;
-	if (!currPtr)
+	if (!*qList)
 	{
 		return -1;
 	}
 	mask = 1;
 	mask <<= numQubits - 1;
-	newList = NULL;
+
+	// a column of identities leaves the list as it is
+	qColumn_Describe(numQubits, qAlgo, &desc);
+	if (desc.Identity)
+		return numQubits;
+
+	// each gate, or pass of fused single qubit gates, reads the current state
+	// and accumulates into a new one, or updates a dense state in place. the
+	// sorted list is only rebuilt once the whole column is done
+	qState_StoreFromList(&curr,numQubits,*qList);
 	for (i = 0; i < numQubits; i++)
 	{
-		if (qAlgo[i] == GATE_H)
-		{
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_H(mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
-		}
-		else if ((qAlgo[i] == GATE_I) || (qAlgo[i] == GATE_C) || (qAlgo[i] == ORACLE_ADD) || (qAlgo[i] == ORACLE_SUB) || (qAlgo[i] == ORACLE_MUL) || (qAlgo[i] == ORACLE_DIV) || (qAlgo[i] == ORACLE_POW) || (qAlgo[i] == ORACLE_MOD) || (qAlgo[i] == ORACLE_NUM))
+		inPlace = 0;
+		if (qColumn_Fusable(qAlgo[i]))
 		{
-			while (currPtr != NULL)
+			end = qColumn_Compile(&desc, i, &column);
+			if (QCOLUMN_EMPTY(&column))
 			{
-				qEmul_InsertInList_I(mask, currPtr, &newList);
-				currPtr = currPtr->next;
+				inPlace = 1; // nothing changes
 			}
-		}
-		else if (qAlgo[i] == GATE_X)
-		{
-			while (currPtr != NULL)
+			else if (curr.Dense || (qState_StoreWantDense(curr.numQubits, (estimate = qColumn_Estimate(&column, &curr))) && qState_StoreMakeDense(&curr)))
 			{
-				qEmul_InsertInList_X(mask, currPtr, &newList);
-				currPtr = currPtr->next;
+				// dense already, or about to be once the branches are done
+				qDense_Column(&curr, &column);
+				inPlace = 1;
 			}
-
-		}
-		else if ((qAlgo[i] == GATE_P) || (qAlgo[i] == GATE_T))
-		{
-			int j;
-			unsigned long tempVal = 1;
-			tempVal <<= numQubits-1;
-			unsigned long cMask = 0;
-
-			for (j = 0; j < numQubits; j++)
-			{
-				if (qAlgo[j] == GATE_C)
-					cMask += tempVal;
-				tempVal >>= 1;
-			}	
-			while (currPtr != NULL)
+			else
 			{
-				if (qAlgo[i] == GATE_P)
-					qEmul_InsertInList_CP(cMask, mask, currPtr, &newList);
-				else // GATE_T
-					qEmul_InsertInList_CT(cMask, mask, currPtr, &newList);
-
-				currPtr = currPtr->next;
+				// cosets that are already well filled would emit a share for
+				// every member, gather them from hash tables instead. so do
+				// the columns whose shares would not add up bit for bit
+				if (curr.Sorted && (!qColumn_Emittable(&column) || ((qState_StoreLive(&curr) << column.numBranch) > QCOLUMN_EMIT_FILL * estimate)))
+					qState_StoreMakeHash(&curr);
+				step.Gate = STEP_COLUMN;
+				step.Column = &column;
+				step.Touch = column.Branch | column.xMask | column.nMask;
+				runStep(&curr,&next,curr.numQubits,&step);
 			}
-
+			// continue after the pass
+			mask >>= end - 1 - i;
+			i = end - 1;
 		}
 		else if (qAlgo[i] == GATE_SWAP)
 		{
-			unsigned long swapMask = 0;
-			unsigned long tempVal = 1;
-			tempVal <<= numQubits-1;
-			int j;
-
 			if (!swapDone)
 			{
-				for (j = 0; j < numQubits; j++)
-				{
-					if (i != j)
-					{
-						if (qAlgo[j] == GATE_SWAP)
-							swapMask += tempVal;
-					}
-					tempVal >>= 1;
-				}	
-				while (currPtr != NULL)
-				{
-					qEmul_InsertInList_swap(swapMask, mask, currPtr, &newList);
-					currPtr = currPtr->next;
-				}
+				step.Gate = STEP_SWAP;
+				step.Mask = mask;
+				step.cMask = desc.swapMask & ~mask;
+				step.Touch = desc.swapMask;
+				runStep(&curr,&next,curr.numQubits,&step);
 				swapDone = 1;
 			}
 			else
 			{
-				while (currPtr != NULL)
-				{
-					qEmul_InsertInList_I(mask, currPtr, &newList);
-					currPtr = currPtr->next;
-				}
+				inPlace = 1;
 			}
 			
 
-		}
-		else if (qAlgo[i] == GATE_Ht)
-		{
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_Ht(mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
-
-		}
-		else if (qAlgo[i] == GATE_Hb)
-		{
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_Hb(mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
-
 		}
 		else if (qAlgo[i] == GATE_DELETE)
 		{
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_d(mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
+			step.Gate = STEP_DELETE;
+			step.Mask = mask;
+			step.Touch = ~0UL;
+			runStep(&curr,&next,curr.numQubits - 1,&step);
 			retQubits--;
 
 		}
 		else if (qAlgo[i] == GATE_CLONE)
 		{
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_c(mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
+			step.Gate = STEP_CLONE;
+			step.Mask = mask;
+			step.Touch = ~0UL;
+			runStep(&curr,&next,curr.numQubits + 1,&step);
 			retQubits++;
 
 		}
 		else if ((qAlgo[i] == MEASURE_0) || (qAlgo[i] == MEASURE_1) || (qAlgo[i] == MEASURE))
 		{
-			unsigned long startCount = qEmul_Count2List(*qList);
+			unsigned long startCount = qState_StoreCount2(&curr);
 			unsigned long endCount = 0;
 			char qubitVal;
 			if (qAlgo[i] == MEASURE)
 			{
-				double chosen = 0;
-				QState * tempPtr = *qList;
-				while (tempPtr != NULL)
-				{
-					chosen += fabs(creal(tempPtr->Count));  
-					chosen += fabs(cimag(tempPtr->Count));
-					tempPtr = tempPtr->next;
-				}
+				double chosen = qState_StoreAbsSum(&curr);
 				
 				if (chosen > 0)	
 				{
 					chosen = (rand() % (int) trunc(chosen)) + 1;
-					tempPtr = *qList; //currPtr;
-					while ((chosen - fabs(creal(tempPtr->Count)) - fabs(cimag(tempPtr->Count))) > 0)
-					{
-						chosen -= fabs(creal(tempPtr->Count));
-						chosen -= fabs(cimag(tempPtr->Count));
-						tempPtr = tempPtr->next;
-					}
-					if ((tempPtr->Value & mask) == 0)	
+					if ((qState_StorePick(&curr,chosen) & mask) == 0)	
 						qubitVal = MEASURE_0;
 					else
 						qubitVal = MEASURE_1;
@@ -1187,150 +1517,74 @@ int qEmul_exec(int numQubits, char * qAlgo, QState ** qList)
 			else
 				qubitVal = qAlgo[i];
 			
-			while (currPtr != NULL)
+			if (curr.Dense)
 			{
 				if (qubitVal == MEASURE_0)
-					qEmul_InsertInList_0(mask, currPtr, &newList);
+					qDense_0(&curr, mask);
 				else
-					qEmul_InsertInList_1(mask, currPtr, &newList);
-				currPtr = currPtr->next;
+					qDense_1(&curr, mask);
 			}
-			endCount = qEmul_Count2List(newList);
+			else
+				qState_StoreFilter(&curr, mask, (qubitVal == MEASURE_0) ? 0 : mask);
+			inPlace = 1;
+			endCount = qState_StoreCount2(&curr);
 			if ((startCount > 0) && (qAlgo[i] != MEASURE))
 			{
 				Probability = (double) (Probability * (double)endCount) / startCount;
 			}
 		}
-		else if (qAlgo[i] == GATE_N)
-		{
-			int j;
-			unsigned long tempVal = 1;
-			tempVal <<= numQubits-1;
-			unsigned long cMask = 0;
-
-			for (j = 0; j < numQubits; j++)
-			{
-				if (qAlgo[j] == GATE_C)
-					cMask += tempVal;
-				tempVal >>= 1;
-			}	
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_CN(cMask, mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
-
-		}
 		else if (qAlgo[i] == ORACLE_EQ)  // invoking oracle
 		{
 			if (oracleDone)
 			{
-				while (currPtr != NULL)
-				{
-					qEmul_InsertInList_I(mask, currPtr, &newList);
-					currPtr = currPtr->next;
-				}
+				inPlace = 1;
 			}
 			else
 			{
-				int j;
-				unsigned long tempVal = 1;
-				tempVal <<= numQubits-1;
-				unsigned long addMask = 0;
-				unsigned long subMask = 0;
-				unsigned long mulMask = 0;
-				unsigned long divMask = 0;
-				unsigned long powMask = 0;
-				unsigned long nMask = 0;
-				unsigned long modMask = 0;
-				unsigned long resMask = 0;
-
-				
-				for (j = 0; j < numQubits; j++)
-				{
-					if (qAlgo[j] == ORACLE_NUM)
-						nMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_ADD)
-						addMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_SUB)
-						subMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_MUL)
-						mulMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_DIV)
-						divMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_MOD)
-						modMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_EQ)
-						resMask += tempVal;
-					else
-					if (qAlgo[j] == ORACLE_POW)
-						powMask += tempVal;
-					tempVal >>= 1;
-				}	
-				while (currPtr != NULL)
-				{
-					qEmul_InsertInList_oracle(nMask,addMask,subMask,mulMask,divMask,modMask,powMask,resMask, currPtr, &newList);
-					currPtr = currPtr->next;
-				}
+				step.Gate = STEP_ORACLE;
+				memcpy(step.Oracle,desc.Oracle,sizeof(step.Oracle));
+				step.Touch = desc.Oracle[7];
+				runStep(&curr,&next,curr.numQubits,&step);
 				oracleDone = 1;
 			}
 		}
 		else if (qAlgo[i] == GATE_QFT)  // invoking QFT
 		{
-			unsigned long qftMask = 0;
-			unsigned long tempVal = 1;
-			tempVal <<= numQubits-1;
-			int j;
-			for (j = 0; j < numQubits; j++)
-			{
-				if (qAlgo[j] == GATE_QFT)
-					qftMask += tempVal;
-				tempVal >>= 1;
-			}	
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_QFT(qftMask, mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
+			step.Gate = STEP_QFT;
+			step.Mask = mask;
+			step.cMask = desc.qftMask;
+			step.Touch = mask;
+			runStep(&curr,&next,curr.numQubits,&step);
 
 		}
 		else if (qAlgo[i] == GATE_INVQFT)  // invoking inverse QFT
 		{
-			unsigned long qftMask = 0;
-			unsigned long tempVal = 1;
-			tempVal <<= numQubits-1;
-			int j;
-			for (j = 0; j < numQubits; j++)
-			{
-				if (qAlgo[j] == GATE_INVQFT)
-					qftMask += tempVal;
-				tempVal >>= 1;
-			}	
-			while (currPtr != NULL)
-			{
-				qEmul_InsertInList_INVQFT(qftMask, mask, currPtr, &newList);
-				currPtr = currPtr->next;
-			}
+			step.Gate = STEP_INVQFT;
+			step.Mask = mask;
+			step.cMask = desc.invQftMask;
+			step.Touch = mask;
+			runStep(&curr,&next,curr.numQubits,&step);
 
 		}
 		else
 		{
 			fprintf(stderr,"ERROR: %c mode not yet implemented\n",qAlgo[i]);
+			newStep(&curr,&next,curr.numQubits);
 			
 		}
-		currPtr = newList;
-		qEmul_FreeList(*qList);
-		*qList = currPtr;
-		newList = NULL;
+		if (!inPlace)
+		{
+			qState_StoreFree(&curr);
+			curr = next;
+		}
+		qState_StoreBalance(&curr);
 		mask >>= 1;
 		
 	}
+	qState_StoreToList(&curr,&newList);
+	qState_StoreFree(&curr);
+	qEmul_FreeList(*qList);
+	*qList = newList;
 
 	return retQubits;
 }
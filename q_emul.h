@@ -25,12 +25,15 @@
 #include <complex.h>
 #include <stdarg.h>
 #include "q_oracle.h"
+#include "q_state.h"
+#include "q_arena.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_QUBITS 63 
+#define MAX_PARAMS 127  // arguments of an oracle or function
 #define Q_VERSION 402
 
 #define GATE_H      'H'
@@ -72,29 +75,42 @@ typedef struct _QState
 double qEmul_GetProbability(void);
 void qEmul_ResetProbability(void);
 int qEmul_Version(void);
+void qEmul_SetThreads(int numThreads);  // 0 or less uses the OpenMP default
+int qEmul_GetThreads(void);
 double complex qEmul_Count2List(QState * qList);
 int qEmul_PrintList(int numQubits, QState * qList, char * outStr, int outStrLen);
 int qEmul_PrintBlock(int numQubits, QState * qList, unsigned long * Block, int BlockSize);
 void qEmul_CreateList(QState ** qList);
+// lists made by qEmul (CreateList, CopyList, Read, exec, oracle ...) are freed
+// with qEmul_FreeList and are passed back with their head unchanged. any other
+// list given to qEmul_exec, qEmul_oracle or qEmul_FreeList must be one malloc
+// per node, qEmul_FreeList gives it back with free(). not thread safe
 void qEmul_FreeList(QState * qList);
-void qEmul_InsertInList_H(unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_X(unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_I(unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_0(unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_1(unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_CP(unsigned long cMask, unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_CT(unsigned long cMask, unsigned long mask,QState * currState, QState ** qList);
-void qEmul_InsertInList_CN(unsigned long cMask, unsigned long mask, QState * currState, QState ** qList);
-void qEmul_InsertInList_swap(unsigned long swapMask, unsigned long mask, QState * currState, QState ** qList);
-void qEmul_InsertInList_QFT(unsigned long qftMask, unsigned long mask, QState * currState, QState ** qList);
+void qEmul_FreeMallocList(QState * qList);
+void qEmul_CopyList(QState * qList, QState ** copy);
+void qEmul_InsertInList_H(unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_X(unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_I(unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_0(unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_1(unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_CP(unsigned long cMask, unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_CT(unsigned long cMask, unsigned long mask,QState * currState, QStore * qStore);
+void qEmul_InsertInList_CN(unsigned long cMask, unsigned long mask, QState * currState, QStore * qStore);
+void qEmul_InsertInList_swap(unsigned long swapMask, unsigned long mask, QState * currState, QStore * qStore);
+void qEmul_InsertInList_QFT(unsigned long qftMask, unsigned long mask, QState * currState, QStore * qStore);
 
-void qEmul_InsertInList_oracle(unsigned long nMask, unsigned long addMask, unsigned long subMask, unsigned long mulMask, unsigned long divMask, unsigned long modMask, unsigned long powMask, unsigned long resMask, QState * currState, QState ** qList);
+void qEmul_InsertInList_oracle(unsigned long nMask, unsigned long addMask, unsigned long subMask, unsigned long mulMask, unsigned long divMask, unsigned long modMask, unsigned long powMask, unsigned long resMask, QState * currState, QStore * qStore);
 
-int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long *), char * oracleParams, QState ** qList);
-int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long *), char * functionParams, QState ** qList);
+int qEmul_oracle(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long *), void * (*Prepare)(unsigned long *), void (*Evaluate)(void *, unsigned long *, unsigned long *, unsigned long), char * oracleParams, QState ** qList);
+int qEmul_function(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long *), void (*Direct)(int, unsigned long *, QState *, QHash *), char * functionParams, QState ** qList);
+int qEmul_oracleArgs(unsigned int numYQubits, unsigned long (*Oracle)(unsigned long *), void * (*Prepare)(unsigned long *), void (*Evaluate)(void *, unsigned long *, unsigned long *, unsigned long), unsigned long * oracleArg, QState ** qList);
+int qEmul_functionArgs(unsigned int numBits, unsigned long * (*Function)(int, unsigned long *, unsigned long *), void (*Direct)(int, unsigned long *, QState *, QHash *), unsigned long * functionArg, QState ** qList);
+int qEmul_ParseParams(char * params, unsigned long * args, int maxArgs);
 
 int qEmul_exec(int numQubits, char * Algo, QState **qList);
 
+int qEmul_Sample(QState * qList, unsigned long qubitMask, unsigned long shots, unsigned long * out);
+int qEmul_SampleMeasure(QState * qList, unsigned long qubitMask, unsigned long shots, unsigned long * out);
 int qEmul_Write(int numQubits, char * fileName, QState * qList);
 int qEmul_Read(int numQubits, char * fileName, QState ** qList);
 
@@ -0,0 +1,128 @@
+/******************************************
+ * Name: q_gf2.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <string.h>
+#include "q_gf2.h"
+
+void qGf2_Init(QGf2Basis * basis, int numCols)
+{
+	memset(basis, 0, sizeof(QGf2Basis));
+	if (numCols > QGF2_MAX_COLS)
+		numCols = QGF2_MAX_COLS;
+	basis->numCols = numCols;
+	basis->ColMask = (numCols > 0) ? (0xFFFFFFFFFFFFFFFF >> (QGF2_MAX_COLS - numCols)) : 0;
+}
+
+// Table[s][x] is the sum of the basis rows whose pivots are the bits of x in
+// strip s, built from x with its lowest bit cleared
+
+static void buildTable(QGf2Basis * basis, int s)
+{
+	unsigned long * table = basis->Table[s];
+	unsigned long x, low;
+	int c;
+
+	table[0] = 0;
+	for (x = 1; x < (1UL << QGF2_STRIP); x++)
+	{
+		low = x & -x;
+		c = s * QGF2_STRIP + __builtin_ctzl(low);
+		table[x] = table[x ^ low];
+		if ((basis->PivotMask >> c) & 1)
+			table[x] ^= basis->Row[c];
+	}
+}
+
+// the basis rows are 0 in each other's pivot columns, so clearing the pivot
+// columns of one strip leaves those of the other strips alone
+
+unsigned long qGf2_Reduce(QGf2Basis * basis, unsigned long row)
+{
+	int s;
+
+	row &= basis->ColMask;
+	for (s = 0; s * QGF2_STRIP < basis->numCols; s++)
+		row ^= basis->Table[s][(row >> (s * QGF2_STRIP)) & ((1UL << QGF2_STRIP) - 1)];
+	return row;
+}
+
+// returns 1 when row was independent of the basis and has been added
+
+int qGf2_Add(QGf2Basis * basis, unsigned long row)
+{
+	unsigned long bit;
+	int p, c, s;
+
+	if (basis->Rank == basis->numCols)
+		return 0;
+	row = qGf2_Reduce(basis, row);
+	if (row == 0)
+		return 0;
+
+	// the lowest column left becomes the pivot, and leaves the other rows
+	p = __builtin_ctzl(row);
+	bit = 1UL << p;
+	for (c = 0; c < basis->numCols; c++)
+	{
+		if (((basis->PivotMask >> c) & 1) && (basis->Row[c] & bit))
+			basis->Row[c] ^= row;
+	}
+	basis->Row[p] = row;
+	basis->PivotMask |= bit;
+	basis->Rank++;
+	for (s = 0; s * QGF2_STRIP < basis->numCols; s++)
+		buildTable(basis, s);
+	return 1;
+}
+
+// one generator per free column f: f itself and every pivot whose row has f
+
+void qGf2_Solutions(QGf2Basis * basis, QGf2Solutions * sol)
+{
+	unsigned long gen;
+	int f, c;
+
+	memset(sol, 0, sizeof(QGf2Solutions));
+	for (f = 0; f < basis->numCols; f++)
+	{
+		if ((basis->PivotMask >> f) & 1)
+			continue;
+		gen = 1UL << f;
+		for (c = 0; c < basis->numCols; c++)
+		{
+			if (((basis->PivotMask >> c) & 1) && ((basis->Row[c] >> f) & 1))
+				gen |= 1UL << c;
+		}
+		sol->Gen[sol->numGen++] = gen;
+	}
+}
+
+// returns 0 once all 2^numGen - 1 solutions have been made
+
+int qGf2_NextSolution(QGf2Solutions * sol, unsigned long * value)
+{
+	if ((sol->numGen < QGF2_MAX_COLS) && (sol->Count + 1 >= (1UL << sol->numGen)))
+		return 0;
+	sol->Count++;
+	sol->Current ^= sol->Gen[__builtin_ctzl(sol->Count)];
+	*value = sol->Current;
+	return 1;
+}
@@ -0,0 +1,71 @@
+/******************************************
+ * Name: q_gf2.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_GF2_H
+#define Q_GF2_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// linear algebra over GF(2) on rows of up to 64 columns, each row packed into
+// an unsigned long with column c at bit c. rows are added one at a time, so
+// they can be read straight from a state list. the basis is kept in reduced
+// row echelon form, and in the style of the Method of Four Russians every
+// QGF2_STRIP columns have a table of all combinations of their pivot rows:
+// a row is reduced with one lookup per strip instead of one XOR per pivot
+
+#define QGF2_MAX_COLS 64
+#define QGF2_STRIP 8
+#define QGF2_STRIPS (QGF2_MAX_COLS / QGF2_STRIP)
+
+typedef struct _QGf2Basis
+{
+  int numCols;
+  int Rank;
+  unsigned long ColMask;                // the low numCols bits
+  unsigned long PivotMask;              // columns holding a pivot
+  unsigned long Row[QGF2_MAX_COLS];     // the basis row whose pivot is column c
+  unsigned long Table[QGF2_STRIPS][1 << QGF2_STRIP];
+} QGf2Basis;
+
+// the non-zero vectors s with row . s = 0 for every row added, made one at a
+// time in Gray code order from the generators of the null space
+
+typedef struct _QGf2Solutions
+{
+  int numGen;
+  unsigned long Gen[QGF2_MAX_COLS];
+  unsigned long Count;                  // solutions made so far
+  unsigned long Current;
+} QGf2Solutions;
+
+void qGf2_Init(QGf2Basis * basis, int numCols);
+unsigned long qGf2_Reduce(QGf2Basis * basis, unsigned long row);
+int qGf2_Add(QGf2Basis * basis, unsigned long row);
+void qGf2_Solutions(QGf2Basis * basis, QGf2Solutions * sol);
+int qGf2_NextSolution(QGf2Solutions * sol, unsigned long * value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+/******************************************
+ * Name: q_modexp.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include "q_modexp.h"
+
+typedef unsigned __int128 QUInt128;
+
+// a * b / 2^64 mod Mod, for a and b below Mod
+
+static inline unsigned long montMul(const QModExp * qModExp, unsigned long a, unsigned long b)
+{
+	QUInt128 t = (QUInt128) a * b;
+	unsigned long q = (unsigned long) t * qModExp->Inv;
+	QUInt128 u = (QUInt128) q * qModExp->Mod;
+	QUInt128 r;
+
+	// the low halves of t and u add up to 0 mod 2^64, carrying unless both are 0
+	r = (t >> 64) + (u >> 64) + ((unsigned long) t != 0);
+	if (r >= qModExp->Mod)
+		r -= qModExp->Mod;
+	return (unsigned long) r;
+}
+
+static inline unsigned long mulMod(const QModExp * qModExp, unsigned long a, unsigned long b)
+{
+	if (qModExp->Montgomery)
+		return montMul(qModExp, a, b);
+	return (unsigned long) (((QUInt128) a * b) % qModExp->Mod);
+}
+
+void qModExp_Init(QModExp * qModExp, unsigned long base, unsigned long mod)
+{
+	unsigned long inv, one;
+	int i, pos;
+
+	qModExp->Mod = mod;
+	qModExp->Montgomery = (mod & 1) && (mod > 1);
+	base %= mod;
+	one = 1 % mod;
+	if (qModExp->Montgomery)
+	{
+		// Newton iteration, each step doubles the correct low bits of mod^-1
+		inv = mod;
+		for (i = 0; i < 5; i++)
+			inv *= 2 - mod * inv;
+		qModExp->Inv = -inv;
+		one = (unsigned long) (((QUInt128) 1 << 64) % mod);
+		qModExp->R2 = (unsigned long) (((QUInt128) one * one) % mod);
+		base = montMul(qModExp, base, qModExp->R2);
+	}
+	for (pos = 0; pos < QMODEXP_DIGITS; pos++)
+	{
+		qModExp->Table[pos][0] = one;
+		for (i = 1; i < (1 << QMODEXP_WINDOW); i++)
+			qModExp->Table[pos][i] = mulMod(qModExp, qModExp->Table[pos][i-1], base);
+		// base^(2^QMODEXP_WINDOW) for the next window
+		base = mulMod(qModExp, qModExp->Table[pos][(1 << QMODEXP_WINDOW) - 1], base);
+	}
+}
+
+unsigned long qModExp_Pow(const QModExp * qModExp, unsigned long exp)
+{
+	unsigned long ret;
+	int pos = 0;
+
+	if (exp == 0)
+		return 1;  // as the square and multiply loop, even for Mod 1
+	while ((exp & ((1 << QMODEXP_WINDOW) - 1)) == 0)
+	{
+		exp >>= QMODEXP_WINDOW;
+		pos++;
+	}
+	ret = qModExp->Table[pos][exp & ((1 << QMODEXP_WINDOW) - 1)];
+	for (exp >>= QMODEXP_WINDOW, pos++; exp != 0; exp >>= QMODEXP_WINDOW, pos++)
+	{
+		if (exp & ((1 << QMODEXP_WINDOW) - 1))
+			ret = mulMod(qModExp, ret, qModExp->Table[pos][exp & ((1 << QMODEXP_WINDOW) - 1)]);
+	}
+	if (qModExp->Montgomery)
+		ret = montMul(qModExp, ret, 1);
+	return ret;
+}
+
+// square and multiply without the tables, for a single power. products of
+// values below 2^32 still fit in 64 bits
+
+unsigned long qModExp_PowOnce(unsigned long base, unsigned long exp, unsigned long mod)
+{
+	unsigned long ret = 1;
+
+	if (exp == 0)
+		return 1;
+	base %= mod;
+	while (exp > 0)
+	{
+		if (mod >> 32)
+		{
+			if (exp & 0x1)
+				ret = (unsigned long) (((QUInt128) ret * base) % mod);
+			base = (unsigned long) (((QUInt128) base * base) % mod);
+		}
+		else
+		{
+			if (exp & 0x1)
+				ret = (ret * base) % mod;
+			base = (base * base) % mod;
+		}
+		exp >>= 1;
+	}
+	return ret;
+}
@@ -0,0 +1,55 @@
+/******************************************
+ * Name: q_modexp.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_MODEXP_H
+#define Q_MODEXP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// base^exp mod Mod for a fixed base and modulus, with 128 bit products so any
+// 64 bit modulus works. odd moduli use Montgomery multiplication, even ones a
+// 128 bit remainder. the base is fixed, so qModExp_Init builds the powers for
+// every QMODEXP_WINDOW bit window of the exponent, and a power is one multiply
+// per non-zero window with no squaring
+
+#define QMODEXP_WINDOW 4
+#define QMODEXP_DIGITS (64 / QMODEXP_WINDOW)
+
+typedef struct _QModExp
+{
+  unsigned long Mod;
+  unsigned long Inv;          // -Mod^-1 mod 2^64, when Montgomery
+  unsigned long R2;           // 2^128 mod Mod, when Montgomery
+  int Montgomery;
+  unsigned long Table[QMODEXP_DIGITS][1 << QMODEXP_WINDOW];  // base^(d << (QMODEXP_WINDOW * pos)), in Montgomery form when Montgomery
+} QModExp;
+
+void qModExp_Init(QModExp * qModExp, unsigned long base, unsigned long mod);
+unsigned long qModExp_Pow(const QModExp * qModExp, unsigned long exp);
+unsigned long qModExp_PowOnce(unsigned long base, unsigned long exp, unsigned long mod);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,9 +21,17 @@
 #include <stdlib.h>
 #include "q_emul.h"
 #include "q_oracle.h"
+#include "q_sha256.h"
+#include "q_chaskey.h"
+#include "q_modexp.h"
+#include "q_aes.h"
+#include "q_gf2.h"
 
 unsigned long (* OracleList[MAX_ORACLE])(unsigned long *);
+void * (* OraclePrepareList[MAX_ORACLE])(unsigned long *);
+void (* OracleEvaluateList[MAX_ORACLE])(void *, unsigned long *, unsigned long *, unsigned long);
 unsigned long * (* FunctionList[MAX_ORACLE])(int, unsigned long *, unsigned long *);
+void (* FunctionDirectList[MAX_FUNCTION])(int, unsigned long *, struct _QState *, struct _QHash *);
 int setupDone = 0;
 
 // internal functions
@@ -55,12 +63,16 @@ typedef struct {
 
 typedef u_int32_t uint32_t;
 typedef u_int8_t uint8_t;
+typedef u_int64_t uint64_t;
 
 static void sha256_init(SHA256_CTX *ctx);
 static void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 static void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
 static void generate_sub_keys(unsigned char* main_key, key_set* key_sets);
 static void process_message(unsigned char* message_piece, unsigned char* processed_piece, key_set* key_sets, int mode);
+static void slice_setup(void);
+static void slice_process_messages(uint64_t * blocks, key_set * key_sets, int mode);
+static void slice_process_passes(uint64_t * blocks, key_set ** key_sets, const int * modes, int passes);
 
 static void subkeys(uint32_t k1[4], uint32_t k2[4], const uint32_t k[4]);
 static void chaskey(uint8_t *tag, uint32_t taglen, const uint8_t *m, const uint32_t mlen, const uint32_t k[4], const uint32_t k1[4], const uint32_t k2[4]);
@@ -75,13 +87,72 @@ void qOracle_setup(void)
 	OracleList[ORACLE_SHA2256] = &Oracle_SHA256;
 	OracleList[ORACLE_EVENMAN_SHA2256] = &Oracle_EvenMansour_SHA256;
 	OracleList[ORACLE_CHASKEY12] = &Oracle_ChasKey12;
+	OracleList[ORACLE_DES] = &Oracle_DES64;
+	OracleList[ORACLE_3DES] = &Oracle_3DES;
+	OracleList[ORACLE_AES128] = &Oracle_AES128;
+	OracleList[ORACLE_AES256] = &Oracle_AES256;
+	OracleList[ORACLE_PADCBC] = &Oracle_PADCBC;
+	OracleList[ORACLE_PADGCM] = &Oracle_PADGCM;
+
+	OraclePrepareList[ORACLE_MODEXP] = &OraclePrepare_ModularExponentiation;
+	OracleEvaluateList[ORACLE_MODEXP] = &OracleEvaluate_ModularExponentiation;
+	OraclePrepareList[ORACLE_EVENMAN_MODEXP] = &OraclePrepare_EvenMansour_ModExp;
+	OracleEvaluateList[ORACLE_EVENMAN_MODEXP] = &OracleEvaluate_ModularExponentiation;
+	OraclePrepareList[ORACLE_SHA2256] = &OraclePrepare_SHA256;
+	OracleEvaluateList[ORACLE_SHA2256] = &OracleEvaluate_SHA256;
+	OraclePrepareList[ORACLE_EVENMAN_SHA2256] = &OraclePrepare_EvenMansour_SHA256;
+	OracleEvaluateList[ORACLE_EVENMAN_SHA2256] = &OracleEvaluate_SHA256;
+	OraclePrepareList[ORACLE_CHASKEY12] = &OraclePrepare_ChasKey12;
+	OracleEvaluateList[ORACLE_CHASKEY12] = &OracleEvaluate_ChasKey12;
+	OraclePrepareList[ORACLE_DES] = &OraclePrepare_DES64;
+	OracleEvaluateList[ORACLE_DES] = &OracleEvaluate_DES64;
+	OraclePrepareList[ORACLE_3DES] = &OraclePrepare_3DES;
+	OracleEvaluateList[ORACLE_3DES] = &OracleEvaluate_3DES;
+	OraclePrepareList[ORACLE_AES128] = &OraclePrepare_AES128;
+	OracleEvaluateList[ORACLE_AES128] = &OracleEvaluate_AES;
+	OraclePrepareList[ORACLE_AES256] = &OraclePrepare_AES256;
+	OracleEvaluateList[ORACLE_AES256] = &OracleEvaluate_AES;
+	OraclePrepareList[ORACLE_PADCBC] = &OraclePrepare_PADCBC;
+	OracleEvaluateList[ORACLE_PADCBC] = &OracleEvaluate_PAD;
+	OraclePrepareList[ORACLE_PADGCM] = &OraclePrepare_PADGCM;
+	OracleEvaluateList[ORACLE_PADGCM] = &OracleEvaluate_PAD;
+
+	slice_setup();
 
 	FunctionList[FUNCTION_GAUSS_ELI] = &Function_Gaussian_Elimination_Binary;
+	FunctionDirectList[FUNCTION_GAUSS_ELI] = &FunctionDirect_Gaussian_Elimination_Binary;
+
+	// the SIMD levels are picked here, before Evaluate runs on several threads
+	qSha256_GetSimdLevel();
+	qChasKey_GetSimdLevel();
+	qAes_GetSimdLevel();
 
 	setupDone = 1;
 }
 
 
+// every context starts with the register split of params[0]
+
+static void * allocContext(size_t size, unsigned long * params)
+{
+	QOracleCtx * reg = (QOracleCtx *) malloc(size);
+
+	if (!reg)
+	{
+		fprintf(stderr,"error: unable to malloc oracle context\n");
+		exit(-1);
+	}
+	memset(reg,0,size);
+	reg->numYQubits = params[0];
+	reg->yMask = reg->numYQubits ? (0xFFFFFFFFFFFFFFFF >> ((sizeof(unsigned long)*8)-reg->numYQubits)) : 0;
+	return reg;
+}
+
+void qOracle_Release(void * context)
+{
+	free(context);
+}
+
 unsigned long Oracle_ModularExponentiation(unsigned long * params)
 {
 	// param 1 = base 
@@ -90,34 +161,12 @@ unsigned long Oracle_ModularExponentiation(unsigned long * params)
 
 	unsigned long numYQubits = params[0];
 	unsigned long value = params[1];
-
-	unsigned long base,mod;
 	unsigned long Yvalue;
-	unsigned long i;
+	unsigned long ret;
 
 	Yvalue = value;
 	value >>= numYQubits;
-	base = params[2];
-	mod = params[3];
-
-	unsigned long ret = 1;
-
-	while (value > 0)
-	{
-		if (value & 0x1)
-			ret = (ret * base) % mod;
-		base = (base * base) % mod;
-		value >>= 1;
-	}
-
-	for (i=1;i<value;i++)
-	{
-		// to optimize
-		ret = (ret * base) % mod;
-	}
-
-	//ret = (unsigned long) pow(base,value);
-	//ret = ret % mod;
+	ret = qModExp_PowOnce(params[2],value,params[3]);
 
 	value = params[1] >> numYQubits;
 	value <<= numYQubits;
@@ -139,26 +188,16 @@ unsigned long Oracle_EvenMansour_ModExp(unsigned long * params)
 	unsigned long numYQubits = params[0];
 	unsigned long value = params[1];
 	unsigned long Yvalue;
-	unsigned int base,mod,k1,k2;
-	unsigned long i;
+	unsigned long k1,k2;
+	unsigned long ret;
 
 	Yvalue = value;
 	value >>= numYQubits;
-	base = params[2];
-	mod = params[3];
 	k1 = params[4];
 	k2 = params[5];
 
 	value = value ^ k1;
-	
-	unsigned long ret = 1;
-	while (value > 0)
-	{
-		if (value & 0x1)
-			ret = (ret * base) % mod;
-		base = (base * base) % mod;
-		value >>= 1;
-	}
+	ret = qModExp_PowOnce(params[2],value,params[3]);
 
 	ret = ret ^ k2;
 	value = params[1] >> numYQubits;
@@ -171,6 +210,45 @@ unsigned long Oracle_EvenMansour_ModExp(unsigned long * params)
 	return ret;
 }
 
+// the exponent is the X register. the power table of the base is built once
+// per !O line, k1 and k2 are 0 for the plain oracle
+
+typedef struct
+{
+	QOracleCtx Reg;
+	QModExp modexp;
+	unsigned long k1,k2;
+} ModExpCtx;
+
+void * OraclePrepare_ModularExponentiation(unsigned long * params)
+{
+	ModExpCtx * ctx = (ModExpCtx *) allocContext(sizeof(ModExpCtx), params);
+
+	qModExp_Init(&(ctx->modexp),params[2],params[3]);
+	return ctx;
+}
+
+void * OraclePrepare_EvenMansour_ModExp(unsigned long * params)
+{
+	ModExpCtx * ctx = (ModExpCtx *) allocContext(sizeof(ModExpCtx), params);
+
+	qModExp_Init(&(ctx->modexp),params[2],params[3]);
+	ctx->k1 = params[4];
+	ctx->k2 = params[5];
+	return ctx;
+}
+
+void OracleEvaluate_ModularExponentiation(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	ModExpCtx * ctx = (ModExpCtx *) context;
+	unsigned long ret, n;
+
+	for (n = 0; n < num; n++)
+	{
+		ret = qModExp_Pow(&(ctx->modexp), values[n] ^ ctx->k1);
+		results[n] = ret ^ ctx->k2;
+	}
+}
 
 unsigned long Oracle_SHA256(unsigned long * params)
 {
@@ -254,6 +332,66 @@ unsigned long Oracle_EvenMansour_SHA256(unsigned long * params)
 	return ret;
 }
 
+// the SHA256 oracles build every message of the batch, then hash them
+// together in SIMD lanes
+
+typedef struct
+{
+	QOracleCtx Reg;
+	unsigned long mask;
+	unsigned long k1;
+	unsigned long k2;
+} ShaCtx;
+
+static void sha256Batch(unsigned long numYQubits, unsigned long * masks, unsigned long * hashes, unsigned long num)
+{
+	unsigned char msg[ORACLE_BATCH * QSHA256_MSG_SIZE];
+	unsigned char digest[ORACLE_BATCH * QSHA256_DIGEST_SIZE];
+	unsigned long n;
+
+	memset(msg,0,num * QSHA256_MSG_SIZE);
+	for (n = 0; n < num; n++)
+	{
+		memcpy(&msg[n * QSHA256_MSG_SIZE],&masks[n],sizeof(unsigned long));
+		msg[n * QSHA256_MSG_SIZE + QSHA256_MSG_SIZE-1] = (unsigned char) numYQubits;
+	}
+	qSha256_Hash32(msg,digest,num);
+	for (n = 0; n < num; n++)
+		memcpy(&hashes[n],&digest[n * QSHA256_DIGEST_SIZE],sizeof(unsigned long));
+}
+
+void * OraclePrepare_SHA256(unsigned long * params)
+{
+	ShaCtx * ctx = (ShaCtx *) allocContext(sizeof(ShaCtx), params);
+
+	ctx->mask = params[2];
+	return ctx;
+}
+
+void * OraclePrepare_EvenMansour_SHA256(unsigned long * params)
+{
+	ShaCtx * ctx = (ShaCtx *) allocContext(sizeof(ShaCtx), params);
+
+	ctx->mask = params[2];
+	ctx->k1 = params[3];
+	ctx->k2 = params[4];
+	return ctx;
+}
+
+// also evaluates Even-Mansour, whose k1 and k2 are 0 for the plain oracle
+
+void OracleEvaluate_SHA256(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	ShaCtx * ctx = (ShaCtx *) context;
+	unsigned long n;
+
+	for (n = 0; n < num; n++)
+		results[n] = ctx->mask ^ values[n] ^ ctx->k1;
+	sha256Batch(ctx->Reg.numYQubits,results,results,num);
+	for (n = 0; n < num; n++)
+		results[n] = (results[n] & ctx->Reg.yMask) ^ ctx->k2;
+}
+
 unsigned long Oracle_ChasKey12(unsigned long * params)
 {
 	// param 1 = keyl  
@@ -295,6 +433,54 @@ unsigned long Oracle_ChasKey12(unsigned long * params)
 	return ret;
 }
 
+// the key schedule and the fixed half of the message are set up once, and
+// the messages of a batch are authenticated together in SIMD lanes
+
+typedef struct
+{
+	QOracleCtx Reg;
+	QChasKey key;
+	unsigned long messagel;
+} ChasKeyCtx;
+
+void * OraclePrepare_ChasKey12(unsigned long * params)
+{
+	ChasKeyCtx * ctx = (ChasKeyCtx *) allocContext(sizeof(ChasKeyCtx), params);
+	unsigned long keyl = params[2];
+	unsigned long keyr = params[3];
+	uint32_t k[4];
+
+	memcpy(k,(unsigned char *) &keyl,sizeof(keyl));
+	memcpy(&k[2],(unsigned char *) &keyr,sizeof(keyr));
+	qChasKey_Schedule(&(ctx->key),k);
+	ctx->messagel = params[4];
+	return ctx;
+}
+
+void OracleEvaluate_ChasKey12(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	ChasKeyCtx * ctx = (ChasKeyCtx *) context;
+	uint32_t msg[4 * ORACLE_BATCH];
+	uint32_t tag[4 * ORACLE_BATCH];
+	unsigned long value, n, done, lanes;
+
+	for (done = 0; done < num; done += lanes)
+	{
+		lanes = (num - done < ORACLE_BATCH) ? num - done : ORACLE_BATCH;
+		for (n = 0; n < lanes; n++)
+		{
+			value = values[done+n];
+			msg[n] = (uint32_t) ctx->messagel;
+			msg[lanes + n] = (uint32_t) (ctx->messagel >> 32);
+			msg[2 * lanes + n] = (uint32_t) value;
+			msg[3 * lanes + n] = (uint32_t) (value >> 32);
+		}
+		qChasKey_Tag16(&(ctx->key),msg,tag,lanes);
+		for (n = 0; n < lanes; n++)
+			results[done+n] = ((unsigned long) tag[n] | ((unsigned long) tag[lanes + n] << 32)) & ctx->Reg.yMask;
+	}
+}
+
 unsigned long Oracle_DES64(unsigned long * params)
 {
 	// param 1 = key 
@@ -341,167 +527,473 @@ unsigned long Oracle_DES64(unsigned long * params)
 	return ret;
 }
 
-unsigned long * Function_Gaussian_Elimination_Binary(int numBits, unsigned long * functionParams, unsigned long * qubitValues)
+// the key schedule is built once, and the blocks go through the bitsliced
+// DES below 64 at a time
+
+typedef struct
 {
-	int i,j;
-	int found, rowDone, numSolutions;
-	unsigned long tempL1,tempL2;
-	unsigned long solutionMask;
-	unsigned long * solutionList;
+	QOracleCtx Reg;
+	int operation;
+	key_set key_sets[17];
+} DesCtx;
 
-/*
-printf("qubitvalues : ");
-for (i=0;i<qubitValues[0];i++)
-	printf(" [%d] %lu ", i, qubitValues[i+1]);
-printf("\n");
-*/
-	if (qubitValues)
+void * OraclePrepare_DES64(unsigned long * params)
+{
+	DesCtx * ctx = (DesCtx *) allocContext(sizeof(DesCtx), params);
+	unsigned long key = params[2];
+	unsigned char deskey[8];
+
+	memset(deskey,0,sizeof(deskey));
+	memset(ctx->key_sets,0,sizeof(ctx->key_sets));
+	memcpy(deskey,(unsigned char *) &key,sizeof(deskey));
+	ctx->operation = (params[3] == 1) ? 1 : 0;
+	generate_sub_keys(deskey,ctx->key_sets);
+	return ctx;
+}
+
+void OracleEvaluate_DES64(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	DesCtx * ctx = (DesCtx *) context;
+	uint64_t blocks[64];
+	unsigned long n, j, lanes;
+
+	for (n = 0; n < num; n += 64)
 	{
-		// look for all zeros
-		j = 0;
-		for (i=0;i<qubitValues[0];i++)
-		{	
-			if (qubitValues[i+1] != 0)
-				j = qubitValues[i+1];
-		}
-		if (j==0) 
+		lanes = (num - n < 64) ? num - n : 64;
+		memset(blocks,0,sizeof(blocks));
+		for (j = 0; j < lanes; j++)
+			blocks[j] = values[n+j];
+		slice_process_messages(blocks,ctx->key_sets,ctx->operation);
+		for (j = 0; j < lanes; j++)
+			results[n+j] = blocks[j] & ctx->Reg.yMask;
+	}
+}
+
+unsigned long Oracle_3DES(unsigned long * params)
+{
+	// param 1 = key 1
+	// param 2 = key 2
+	// param 3 = key 3
+	// param 4 = operation {0 = encrypt, 1 = decrypt, default = encrypt}
+	// encrypt is E(key 3, D(key 2, E(key 1, X)))
+
+	unsigned long numYQubits = params[0];
+	unsigned long value = params[1];
+	unsigned long Yvalue;
+	unsigned long ret;
+	unsigned char deskey[8];
+	unsigned char inblock[8];
+	unsigned char outblock[8];
+	key_set key_sets[3][17];
+	int k, pass;
+
+	memset(inblock,0,sizeof(inblock));
+	memset(outblock,0,sizeof(outblock));
+	memset(key_sets,0,sizeof(key_sets));
+
+	for (k=0;k<3;k++)
+	{
+		memset(deskey,0,sizeof(deskey));
+		memcpy(deskey,(unsigned char *) &params[2+k],sizeof(deskey));
+		generate_sub_keys(deskey,key_sets[k]);
+	}
+
+	Yvalue = value;
+	value >>= numYQubits;
+
+	memcpy(inblock,(unsigned char *)&value,sizeof(inblock));
+	for (pass=0;pass<3;pass++)
+	{
+		if (params[5] == 1)
+			process_message(inblock,outblock,key_sets[2-pass],(pass == 1) ? ENCRYPTION_MODE : DECRYPTION_MODE);
+		else
+			process_message(inblock,outblock,key_sets[pass],(pass == 1) ? DECRYPTION_MODE : ENCRYPTION_MODE);
+		memcpy(inblock,outblock,sizeof(inblock));
+	}
+
+	memcpy(&ret,outblock,sizeof(unsigned long));
+	ret &= (0xFFFFFFFFFFFFFFFF >> ((sizeof(unsigned long)*8)-numYQubits));
+
+	value = params[1] >> numYQubits;
+	value <<= numYQubits;
+	Yvalue -= value;
+
+	ret = ret ^ Yvalue;
+	ret += value;		
+	
+	return ret;
+}
+
+// the three key schedules are built once, and the blocks stay bitsliced
+// through all three passes
+
+typedef struct
+{
+	QOracleCtx Reg;
+	int modes[3];
+	key_set key_sets[3][17];
+} Des3Ctx;
+
+void * OraclePrepare_3DES(unsigned long * params)
+{
+	Des3Ctx * ctx = (Des3Ctx *) allocContext(sizeof(Des3Ctx), params);
+	unsigned char deskey[8];
+	int k;
+
+	memset(ctx->key_sets,0,sizeof(ctx->key_sets));
+	for (k=0;k<3;k++)
+	{
+		memset(deskey,0,sizeof(deskey));
+		// decryption runs the keys backwards
+		memcpy(deskey,(unsigned char *) &params[(params[5] == 1) ? 4-k : 2+k],sizeof(deskey));
+		generate_sub_keys(deskey,ctx->key_sets[k]);
+		if (params[5] == 1)
+			ctx->modes[k] = (k == 1) ? ENCRYPTION_MODE : DECRYPTION_MODE;
+		else
+			ctx->modes[k] = (k == 1) ? DECRYPTION_MODE : ENCRYPTION_MODE;
+	}
+	return ctx;
+}
+
+void OracleEvaluate_3DES(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	Des3Ctx * ctx = (Des3Ctx *) context;
+	key_set * key_sets[3] = {ctx->key_sets[0], ctx->key_sets[1], ctx->key_sets[2]};
+	uint64_t blocks[64];
+	unsigned long n, j, lanes;
+
+	for (n = 0; n < num; n += 64)
+	{
+		lanes = (num - n < 64) ? num - n : 64;
+		memset(blocks,0,sizeof(blocks));
+		for (j = 0; j < lanes; j++)
+			blocks[j] = values[n+j];
+		slice_process_passes(blocks,key_sets,ctx->modes,3);
+		for (j = 0; j < lanes; j++)
+			results[n+j] = blocks[j] & ctx->Reg.yMask;
+	}
+}
+
+// AES-128 and AES-256 encryption of X, which fills the first 8 bytes of the
+// block with the rest 0. the first 8 bytes of the ciphertext go to Y
+
+typedef struct
+{
+	QOracleCtx Reg;
+	QAes aes;
+} AesCtx;
+
+static void * aesPrepare(unsigned long * params, int keyBits)
+{
+	AesCtx * ctx = (AesCtx *) allocContext(sizeof(AesCtx), params);
+
+	// params 2 onwards = key, keyBits/64 words
+	qAes_Schedule(&(ctx->aes),(uint8_t *) &params[2],keyBits);
+	return ctx;
+}
+
+void * OraclePrepare_AES128(unsigned long * params)
+{
+	return aesPrepare(params,128);
+}
+
+void * OraclePrepare_AES256(unsigned long * params)
+{
+	return aesPrepare(params,256);
+}
+
+void OracleEvaluate_AES(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	AesCtx * ctx = (AesCtx *) context;
+	uint8_t blocks[ORACLE_BATCH * QAES_BLOCK_SIZE];
+	unsigned long n, j, lanes;
+
+	for (n = 0; n < num; n += ORACLE_BATCH)
+	{
+		lanes = (num - n < ORACLE_BATCH) ? num - n : ORACLE_BATCH;
+		memset(blocks,0,lanes * QAES_BLOCK_SIZE);
+		for (j = 0; j < lanes; j++)
+			memcpy(&blocks[j * QAES_BLOCK_SIZE],&values[n+j],sizeof(unsigned long));
+		qAes_Encrypt(&(ctx->aes),blocks,blocks,lanes);
+		for (j = 0; j < lanes; j++)
 		{
-			qubitValues[0] = 1;
-			qubitValues[1] = 0;
-			return qubitValues;
+			memcpy(&results[n+j],&blocks[j * QAES_BLOCK_SIZE],sizeof(unsigned long));
+			results[n+j] &= ctx->Reg.yMask;
 		}
+	}
+}
+
+// the per amplitude oracles below go through their prepared versions
+
+static unsigned long evaluateOnce(void * (*Prepare)(unsigned long *), void (*Evaluate)(void *, unsigned long *, unsigned long *, unsigned long), unsigned long * params)
+{
+	unsigned long numYQubits = params[0];
+	unsigned long yMask = numYQubits ? (0xFFFFFFFFFFFFFFFF >> ((sizeof(unsigned long)*8)-numYQubits)) : 0;
+	unsigned long value = params[1] >> numYQubits;
+	unsigned long ret;
+	void * ctx = Prepare(params);
+
+	Evaluate(ctx,&value,&ret,1);
+	qOracle_Release(ctx);
+	return (ret ^ (params[1] & yMask)) + (params[1] & ~yMask);
+}
+
+unsigned long Oracle_AES128(unsigned long * params)
+{
+	// param 1 = key low 8 bytes
+	// param 2 = key high 8 bytes
+	return evaluateOnce(&OraclePrepare_AES128,&OracleEvaluate_AES,params);
+}
+
+unsigned long Oracle_AES256(unsigned long * params)
+{
+	// param 1 .. param 4 = key, 8 bytes each from the low end
+	return evaluateOnce(&OraclePrepare_AES256,&OracleEvaluate_AES,params);
+}
+
+// padding oracles. both decrypt one block whose plaintext is P0 ^ X, with X
+// in the last 8 bytes, and put 1 in Y when the plaintext ends in valid
+// PKCS#7 padding. P0 and the GHASH terms only need the cipher once per call
+
+typedef struct
+{
+	QOracleCtx Reg;
+	uint64_t plain[2];          // the plaintext for X = 0
+	uint64_t tag[2];            // GCM: tag of the ciphertext for X = 0
+	uint64_t expect[2];         // GCM: the tag to match, in its first tagBits
+	uint64_t tagMask[2];
+	uint64_t delta[64][2];      // GCM: what bit j of X adds to the tag
+	int gcm;
+} PadCtx;
+
+static unsigned long padValid(const uint64_t * plain)
+{
+	uint8_t p[QAES_BLOCK_SIZE];
+	unsigned long valid;
+	int n, i;
+
+	memcpy(p,plain,sizeof(p));
+	n = p[QAES_BLOCK_SIZE-1];
+	valid = ((n >= 1) && (n <= QAES_BLOCK_SIZE));
+	for (i = 1; valid && (i < n); i++)
+		valid = (p[QAES_BLOCK_SIZE-1-i] == n);
+	return valid;
+}
+
+// z = x y in GF(2^128) with the GCM bit order
+
+static void gcmMul(uint8_t * z, const uint8_t * x, const uint8_t * y)
+{
+	uint8_t v[QAES_BLOCK_SIZE], r[QAES_BLOCK_SIZE];
+	int i, j, lsb;
 
-		rowDone = 0;
-		for (j = 0; j < numBits; j++)
+	memset(r,0,sizeof(r));
+	memcpy(v,y,sizeof(v));
+	for (i = 0; i < 128; i++)
+	{
+		if ((x[i/8] >> (7 - i%8)) & 1)
 		{
-			tempL1 = 1 << j;
-			found = 0;
-			for (i=rowDone;i<qubitValues[0];i++)
-			{
-				if (qubitValues[i+1] & tempL1) // found
-				{
-					if (!found)
-					{
-						if (i != rowDone)  // need to swap the values to bring the found value forward
-						{
-							tempL2 = qubitValues[rowDone+1];
-							qubitValues[rowDone+1] = qubitValues[i+1];
-							qubitValues[i+1] = tempL2;
-						}
-						found = 1;
-						rowDone++;
-					}
-				}
-			}
-			if (found)
-			{
-				for (i=0;i<qubitValues[0];i++)
-				{
-					if ((i+1) == rowDone)
-						continue;
-					else
-					{
-						if (qubitValues[i+1] & tempL1)
-						{
-							qubitValues[i+1] ^= qubitValues[rowDone];				
-						}
-					}
-				}
-			}
+			for (j = 0; j < QAES_BLOCK_SIZE; j++)
+				r[j] ^= v[j];
 		}
-		// elimination done, now to solve
-		// theory: 
-		// 1. if only 1 bit is set, then that position should be 0
-		// 2. if > 1 bits s set, then all positions should be 1 
-/*
-printf("qubitvalues : ");
-for (i=0;i<qubitValues[0];i++)
-	printf(" [%d] %lu ", i, qubitValues[i+1]);
-printf("\n");
-*/
+		lsb = v[QAES_BLOCK_SIZE-1] & 1;
+		for (j = QAES_BLOCK_SIZE-1; j > 0; j--)
+			v[j] = (v[j] >> 1) | (v[j-1] << 7);
+		v[0] >>= 1;
+		if (lsb)
+			v[0] ^= 0xe1;
+	}
+	memcpy(z,r,sizeof(r));
+}
 
+void * OraclePrepare_PADCBC(unsigned long * params)
+{
+	// params 2, 3 = key, params 4, 5 = ciphertext block, params 6, 7 =
+	// previous ciphertext block, which X is XORed into
+	PadCtx * ctx = (PadCtx *) allocContext(sizeof(PadCtx), params);
+	QAes aes;
+
+	qAes_Schedule(&aes,(uint8_t *) &params[2],128);
+	qAes_DecryptBlock(&aes,(uint8_t *) &params[4],(uint8_t *) ctx->plain);
+	ctx->plain[0] ^= params[6];
+	ctx->plain[1] ^= params[7];
+	return ctx;
+}
 
-		tempL2 = 0xFFFFFFFFFFFFFFFF >> (64 - numBits) ;  // assuming tempL2 is unsigned long
-		tempL1 = 1;
-		solutionMask = 0;
-		rowDone = 0;
-		for (i=0;i<numBits;i++)	
-		{
-			if ((tempL1 & qubitValues[rowDone+1]) > 0)
-			{
-				if ((tempL1 & qubitValues[rowDone+1]) == qubitValues[rowDone+1])  // only 1 bit set 
-				{
-					tempL2 ^= tempL1;
-				}
-				rowDone++;
-			}
-			else
-				solutionMask |= tempL1; // possibly more than 1 solution
+void * OraclePrepare_PADGCM(unsigned long * params)
+{
+	// params 2, 3 = key, params 4, 5 = ciphertext block, which X is XORed
+	// into, params 6, 7 = tag, params 8, 9 = 12 byte nonce, param 10 = tag
+	// bits compared (0 for all 128). valid needs the tag and the padding
+	PadCtx * ctx = (PadCtx *) allocContext(sizeof(PadCtx), params);
+	uint8_t block[QAES_BLOCK_SIZE], h[QAES_BLOCK_SIZE], h2[QAES_BLOCK_SIZE];
+	uint8_t j0[QAES_BLOCK_SIZE], ek[2][QAES_BLOCK_SIZE], mask[QAES_BLOCK_SIZE];
+	int tagBits = ((params[10] == 0) || (params[10] > 128)) ? 128 : params[10];
+	QAes aes;
+	int i;
 
-			tempL1<<=1;
-		}
-				
-		qubitValues[1] = tempL2;  // store the first solution
+	ctx->gcm = 1;
+	qAes_Schedule(&aes,(uint8_t *) &params[2],128);
+	memset(h,0,sizeof(h));
+	qAes_Encrypt(&aes,h,h,1);
+	gcmMul(h2,h,h);
+
+	// E(J0) masks the tag, E(J0 + 1) is the keystream of the block
+	memset(j0,0,sizeof(j0));
+	memcpy(j0,&params[8],8);
+	memcpy(&j0[8],&params[9],4);
+	memcpy(ek[0],j0,sizeof(j0));
+	ek[0][QAES_BLOCK_SIZE-1] = 1;
+	memcpy(ek[1],j0,sizeof(j0));
+	ek[1][QAES_BLOCK_SIZE-1] = 2;
+	qAes_Encrypt(&aes,ek[0],ek[0],2);
+
+	memcpy(block,&params[4],sizeof(block));
+	for (i = 0; i < QAES_BLOCK_SIZE; i++)
+		ctx->plain[i/8] ^= (uint64_t) (block[i] ^ ek[1][i]) << (8 * (i%8));
+
+	// one block and no AAD: GHASH = C H^2 ^ L H, L holding the 128 bit length
+	gcmMul(block,block,h2);
+	memset(mask,0,sizeof(mask));
+	mask[QAES_BLOCK_SIZE-1] = 0x80;
+	gcmMul(mask,mask,h);
+	for (i = 0; i < QAES_BLOCK_SIZE; i++)
+		block[i] ^= mask[i] ^ ek[0][i];
+	memcpy(ctx->tag,block,sizeof(block));
+
+	for (i = 0; i < 64; i++)
+	{
+		memset(block,0,sizeof(block));
+		block[8 + i/8] = 1 << (i%8);
+		gcmMul(block,block,h2);
+		memcpy(ctx->delta[i],block,sizeof(block));
+	}
 
-		if (solutionMask > 0)
-		{
-			tempL2 = solutionMask;
-			numSolutions = 1;
-			while (tempL2 > 0) // count number of bits
-			{
-				if ((tempL2 & 0x01) > 0)
-					numSolutions<<=1;
-				tempL2>>=1;
-			}
-			numSolutions--; 		// we can ignore mask 00000...000
+	memset(mask,0,sizeof(mask));
+	for (i = 0; i < tagBits; i++)
+		mask[i/8] |= 0x80 >> (i%8);
+	memcpy(ctx->tagMask,mask,sizeof(mask));
+	ctx->expect[0] = params[6] & ctx->tagMask[0];
+	ctx->expect[1] = params[7] & ctx->tagMask[1];
+	return ctx;
+}
 
-			solutionList = (unsigned long *) malloc(numSolutions * sizeof(unsigned long));
-			if (!solutionList)
-			{
-				fprintf(stderr,"error: unable to malloc solutionList\n");
-				return NULL;
-			}
-			for (i=0;i<numSolutions;i++)
-				solutionList[i] = 0;
-			tempL1 = 1;
-			for (i=0;i<numBits;i++)
+void OracleEvaluate_PAD(void * context, unsigned long * values, unsigned long * results, unsigned long num)
+{
+	PadCtx * ctx = (PadCtx *) context;
+	uint64_t plain[2], tag[2], bit;
+	unsigned long n;
+	int j;
+
+	for (n = 0; n < num; n++)
+	{
+		plain[0] = ctx->plain[0];
+		plain[1] = ctx->plain[1] ^ values[n];
+		results[n] = padValid(plain);
+		if (ctx->gcm)
+		{
+			// GHASH is linear in the ciphertext, so the tag is the X = 0 one
+			// plus the terms of the bits of X
+			tag[0] = ctx->tag[0];
+			tag[1] = ctx->tag[1];
+			for (j = 0; j < 64; j++)
 			{
-				if (tempL1 & solutionMask)
-				{
-					for (j=0;j<numSolutions;j++)
-					{
-						if ((j+1) & tempL1)
-						{
-							solutionList[j] |= tempL1;
-						}
-					}
-				}
-				tempL1<<=1;
+				bit = -(uint64_t) ((values[n] >> j) & 1);
+				tag[0] ^= ctx->delta[j][0] & bit;
+				tag[1] ^= ctx->delta[j][1] & bit;
 			}
-			j = 1;
-			for (i=0;i<numSolutions;i++)
-			{
-				tempL2 = solutionList[i] ^ qubitValues[1];
-				if (tempL2)
-				{
-					if (j < qubitValues[0])
-					{
-						j++;
-						qubitValues[j] = tempL2;
-					}
-					else
-						break;  // no more space to return more solutions
-				}
-			}	
-			free(solutionList);
-			qubitValues[0] = j;
+			if (((tag[0] & ctx->tagMask[0]) != ctx->expect[0]) || ((tag[1] & ctx->tagMask[1]) != ctx->expect[1]))
+				results[n] = 0;
 		}
+		results[n] &= ctx->Reg.yMask;
+	}
+}
+
+unsigned long Oracle_PADCBC(unsigned long * params)
+{
+	return evaluateOnce(&OraclePrepare_PADCBC,&OracleEvaluate_PAD,params);
+}
+
+unsigned long Oracle_PADGCM(unsigned long * params)
+{
+	return evaluateOnce(&OraclePrepare_PADGCM,&OracleEvaluate_PAD,params);
+}
+
+// Simon's algorithm: the values are samples y with y . s = 0 on the low
+// numBits bits, and the answer is the non-zero s solving all of them. with
+// only the zero solution, or only zero samples, the answer is 0.
+// a few samples on a wide register leave up to 2^(numBits - 1) solutions, so
+// at most as many are given back as there are samples, or numBits - 1 if
+// that is more. it is the room qEmul_functionArgs gives the array version
 
-			
+static unsigned long gaussMaxSolutions(int numBits, unsigned long numSamples)
+{
+	return (numSamples > (unsigned long) numBits - 1) ? numSamples : (unsigned long) numBits - 1;
+}
+
+unsigned long * Function_Gaussian_Elimination_Binary(int numBits, unsigned long * functionParams, unsigned long * qubitValues)
+{
+	QGf2Basis basis;
+	QGf2Solutions sol;
+	unsigned long i, num, value, max;
+
+	if (qubitValues)
+	{
+		qGf2_Init(&basis,numBits);
+		for (i=0;i<qubitValues[0];i++)
+			qGf2_Add(&basis,qubitValues[i+1]);
+		qGf2_Solutions(&basis,&sol);
+
+		// qubitValues[0] counts the samples and is also the room there is
+		max = gaussMaxSolutions(numBits,qubitValues[0]);
+		if (max > qubitValues[0])
+			max = qubitValues[0];
+		num = 0;
+		if (basis.Rank > 0)
+		{
+			while ((num < max) && qGf2_NextSolution(&sol,&value))
+				qubitValues[++num] = value;
+		}
+		if (num == 0)
+		{
+			num = 1;
+			qubitValues[1] = 0;
+		}
+		qubitValues[0] = num;
 	}	
 	return qubitValues;
 }
 
+// the same, reading the samples from the state list as it is
+
+void FunctionDirect_Gaussian_Elimination_Binary(int numBits, unsigned long * functionParams, struct _QState * qList, struct _QHash * results)
+{
+	QGf2Basis basis;
+	QGf2Solutions sol;
+	QState * currPtr;
+	unsigned long count = 0, num = 0, value, max;
+
+	qGf2_Init(&basis,numBits);
+	for (currPtr = qList; currPtr; currPtr = currPtr->next)
+	{
+		qGf2_Add(&basis,currPtr->Value);
+		count++;
+	}
+	qGf2_Solutions(&basis,&sol);
+
+	max = gaussMaxSolutions(numBits,count);
+	if (basis.Rank > 0)
+	{
+		while ((num < max) && qGf2_NextSolution(&sol,&value))
+		{
+			qState_HashAdd(results,value,1.0);
+			num++;
+		}
+	}
+	if (num == 0)
+		qState_HashAdd(results,0,1.0);
+}
+
 // internal functions
 
 /*********************************************************************
@@ -1245,3 +1737,133 @@ static void process_message(unsigned char* message_piece, unsigned char* process
 	
 
 	
+
+/*******
+  bitsliced DES, 64 blocks per pass. bit j of slice b is bit b of block j, with
+  the bits numbered from 1 at the top of the first byte as in process_message.
+  the permutations only pick slices, the subkeys are all 0 or all 1 slices
+  and each S box output bit is a multiplexer tree over its 6 input slices.
+  gives the same output as process_message on every block
+*******/
+
+static uint64_t slice_truth[8][4];  // S box n output bit o for each 6 bit input b1..b6
+
+static void slice_setup(void) {
+	int * sbox[8] = {S1, S2, S3, S4, S5, S6, S7, S8};
+	int n, o, x, row, column;
+
+	for (n=0; n<8; n++) {
+		for (o=0; o<4; o++) {
+			slice_truth[n][o] = 0;
+			for (x=0; x<64; x++) {
+				row = ((x & 0x20) >> 4) | (x & 0x01);
+				column = (x & 0x1E) >> 1;
+				if ((sbox[n][row*16+column] >> (3-o)) & 1)
+					slice_truth[n][o] |= 1ULL << x;
+			}
+		}
+	}
+}
+
+// in[0..5] are the slices of b1..b6, the tree selects on b6 first
+
+static uint64_t slice_sbox(uint64_t truth, const uint64_t * in) {
+	uint64_t g[32];
+	int h, n, s;
+
+	for (h=0; h<32; h++) {
+		switch ((truth >> (2*h)) & 3) {
+			case 0: g[h] = 0; break;
+			case 1: g[h] = ~in[5]; break;
+			case 2: g[h] = in[5]; break;
+			default: g[h] = ~0ULL; break;
+		}
+	}
+	for (n=16, s=4; n>=1; n>>=1, s--) {
+		for (h=0; h<n; h++)
+			g[h] = g[2*h] ^ ((g[2*h] ^ g[2*h+1]) & in[s]);
+	}
+	return g[0];
+}
+
+// 64x64 bit transpose in place: row r bit (63-c) swaps with row c bit (63-r)
+
+static void slice_transpose(uint64_t * a) {
+	uint64_t m = 0x00000000FFFFFFFFULL, t;
+	int j, k;
+
+	for (j=32; j!=0; j>>=1, m^=m<<j) {
+		for (k=0; k<64; k=((k|j)+1)&~j) {
+			t = (a[k] ^ (a[k|j] >> j)) & m;
+			a[k] ^= t;
+			a[k|j] ^= t << j;
+		}
+	}
+}
+
+// block bit i, counted from the top of the first byte in memory order
+#define SLICE_BIT(i) ((((i)/8)*8) + 7 - ((i)%8))
+
+// 16 rounds on the slices of l and r, leaving them as the r then l of
+// pre_end_permutation. that is also what the initial permutation of a next
+// pass makes of the output, so passes chain without leaving the slices
+
+static void slice_rounds(uint64_t * l, uint64_t * r, key_set * key_sets, int mode) {
+	uint64_t rn[32], er[48], ser[32];
+	int i, k, n, key_index;
+
+	for (k=1; k<=16; k++) {
+		if (mode == DECRYPTION_MODE) {
+			key_index = 17 - k;
+		} else {
+			key_index = k;
+		}
+
+		for (i=0; i<48; i++) {
+			er[i] = r[message_expansion[i] - 1];
+			if ((key_sets[key_index].k[i/8] >> (7 - i%8)) & 1)
+				er[i] = ~er[i];
+		}
+		for (n=0; n<8; n++) {
+			for (i=0; i<4; i++)
+				ser[n*4+i] = slice_sbox(slice_truth[n][i], &er[n*6]);
+		}
+		for (i=0; i<32; i++)
+			rn[i] = ser[right_sub_message_permutation[i] - 1] ^ l[i];
+
+		memcpy(l, r, 32 * sizeof(uint64_t));
+		memcpy(r, rn, 32 * sizeof(uint64_t));
+	}
+	memcpy(rn, l, sizeof(rn));
+	memcpy(l, r, 32 * sizeof(uint64_t));
+	memcpy(r, rn, 32 * sizeof(uint64_t));
+}
+
+// passes DES operations one after the other on 64 blocks, pass p with the
+// key schedule key_sets[p] in modes[p]
+
+static void slice_process_passes(uint64_t * blocks, key_set ** key_sets, const int * modes, int passes) {
+	uint64_t x[64], l[32], r[32];
+	int i, n, p;
+
+	slice_transpose(blocks);
+	for (i=0; i<64; i++)
+		x[i] = blocks[63 - SLICE_BIT(initial_message_permutation[i] - 1)];
+	for (i=0; i<32; i++) {
+		l[i] = x[i];
+		r[i] = x[i+32];
+	}
+
+	for (p=0; p<passes; p++)
+		slice_rounds(l, r, key_sets[p], modes[p]);
+
+	for (i=0; i<64; i++) {
+		n = final_message_permutation[i] - 1;
+		blocks[63 - SLICE_BIT(i)] = (n < 32) ? l[n] : r[n - 32];
+	}
+	slice_transpose(blocks);
+}
+
+static void slice_process_messages(uint64_t * blocks, key_set * key_sets, int mode) {
+	slice_process_passes(blocks, &key_sets, &mode, 1);
+}
@@ -41,17 +41,72 @@
 #define FUNCTION_GAUSS_ELI	10
 
 extern unsigned long (* OracleList[MAX_ORACLE])(unsigned long *);
+
+// two phase oracles, optional per oracle. Prepare parses the !O parameters
+// once (params as for OracleList, without the value in params[1]) and returns
+// a context with the key schedules and tables. Evaluate then takes num X
+// register values (the value shifted right by numYQubits) and fills results
+// with what each one XORs into the Y register. it depends on nothing else, so
+// results can be cached and shared between equal X. Evaluate may run on
+// several threads at once with the same context. the context is released
+// with qOracle_Release
+
+#define ORACLE_BATCH 64  // values handed to Evaluate at a time
+
+typedef struct _QOracleCtx
+{
+  unsigned long numYQubits;
+  unsigned long yMask;        // the Y register, the low numYQubits bits
+} QOracleCtx;                 // first member of every context
+
+extern void * (* OraclePrepareList[MAX_ORACLE])(unsigned long *);
+extern void (* OracleEvaluateList[MAX_ORACLE])(void *, unsigned long *, unsigned long *, unsigned long);
 extern unsigned long * (* FunctionList[MAX_FUNCTION])(int, unsigned long *, unsigned long *);
 
+// optional per function, reads the values from the state list in place and
+// adds its output values to results, instead of getting them copied into the
+// qubitValues array of FunctionList
+
+struct _QState;
+struct _QHash;
+extern void (* FunctionDirectList[MAX_FUNCTION])(int, unsigned long *, struct _QState *, struct _QHash *);
+
 void qOracle_setup(void);
+void qOracle_Release(void * context);
 unsigned long Oracle_ModularExponentiation(unsigned long * params);
 unsigned long Oracle_EvenMansour_ModExp(unsigned long * params);
 unsigned long Oracle_SHA256(unsigned long * params);
 unsigned long Oracle_EvenMansour_SHA256(unsigned long * params);
 
 unsigned long Oracle_ChasKey12(unsigned long * params);
+unsigned long Oracle_DES64(unsigned long * params);
+unsigned long Oracle_3DES(unsigned long * params);
+unsigned long Oracle_AES128(unsigned long * params);
+unsigned long Oracle_AES256(unsigned long * params);
+unsigned long Oracle_PADCBC(unsigned long * params);
+unsigned long Oracle_PADGCM(unsigned long * params);
+
+void * OraclePrepare_ModularExponentiation(unsigned long * params);
+void * OraclePrepare_EvenMansour_ModExp(unsigned long * params);
+void * OraclePrepare_SHA256(unsigned long * params);
+void * OraclePrepare_EvenMansour_SHA256(unsigned long * params);
+void * OraclePrepare_ChasKey12(unsigned long * params);
+void * OraclePrepare_DES64(unsigned long * params);
+void * OraclePrepare_3DES(unsigned long * params);
+void * OraclePrepare_AES128(unsigned long * params);
+void * OraclePrepare_AES256(unsigned long * params);
+void * OraclePrepare_PADCBC(unsigned long * params);
+void * OraclePrepare_PADGCM(unsigned long * params);
+void OracleEvaluate_ModularExponentiation(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_SHA256(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_ChasKey12(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_DES64(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_3DES(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_AES(void * context, unsigned long * values, unsigned long * results, unsigned long num);
+void OracleEvaluate_PAD(void * context, unsigned long * values, unsigned long * results, unsigned long num);
 
 unsigned long * Function_Gaussian_Elimination_Binary(int numBits, unsigned long * functionParams, unsigned long * qubitValues);
+void FunctionDirect_Gaussian_Elimination_Binary(int numBits, unsigned long * functionParams, struct _QState * qList, struct _QHash * results);
 
 
 #endif
@@ -0,0 +1,220 @@
+/******************************************
+ * Name: q_sha256.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#include <string.h>
+#include <stdint.h>
+#include "q_sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QSHA256_X86
+#endif
+
+// the round constants and initial state of FIPS 180-4, as in the scalar
+// sha256_transform of q_oracle.c
+
+static const uint32_t K256[64] = {
+	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+	0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+	0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+	0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+	0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+	0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+	0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static const uint32_t H256[8] = {
+	0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+};
+
+// a 32 byte message fills words 0-7 of the block. the padding is fixed: the
+// 0x80 marker in word 8, zeros, and the 256 bit length in word 15
+
+#define QSHA256_PAD 0x80000000
+#define QSHA256_BITLEN 256
+
+// one lane per element of a gcc vector of 32 bit words. the same body is
+// compiled for every width, the wider ones with their target enabled
+
+#define ROTR(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x) (ROTR(x,2) ^ ROTR(x,13) ^ ROTR(x,22))
+#define S1(x) (ROTR(x,6) ^ ROTR(x,11) ^ ROTR(x,25))
+#define s0(x) (ROTR(x,7) ^ ROTR(x,18) ^ ((x) >> 3))
+#define s1(x) (ROTR(x,17) ^ ROTR(x,19) ^ ((x) >> 10))
+#define CHOOSE(x,y,z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJORITY(x,y,z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define QSHA256_LANES(NAME, VEC, LANES, TARGET) \
+TARGET static void NAME(const unsigned char * msg, unsigned char * digest) \
+{ \
+	VEC w[64], v[8], t1, t2; \
+	int i, l; \
+\
+	for (i = 0; i < 8; i++) \
+	{ \
+		for (l = 0; l < LANES; l++) \
+		{ \
+			const unsigned char * p = &msg[l * QSHA256_MSG_SIZE + 4 * i]; \
+			w[i][l] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]; \
+		} \
+	} \
+	w[8] = (VEC) {} + QSHA256_PAD; \
+	for (i = 9; i < 15; i++) \
+		w[i] = (VEC) {}; \
+	w[15] = (VEC) {} + QSHA256_BITLEN; \
+	for (i = 16; i < 64; i++) \
+		w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16]; \
+\
+	for (i = 0; i < 8; i++) \
+		v[i] = (VEC) {} + H256[i]; \
+	for (i = 0; i < 64; i++) \
+	{ \
+		t1 = v[7] + S1(v[4]) + CHOOSE(v[4], v[5], v[6]) + K256[i] + w[i]; \
+		t2 = S0(v[0]) + MAJORITY(v[0], v[1], v[2]); \
+		v[7] = v[6]; \
+		v[6] = v[5]; \
+		v[5] = v[4]; \
+		v[4] = v[3] + t1; \
+		v[3] = v[2]; \
+		v[2] = v[1]; \
+		v[1] = v[0]; \
+		v[0] = t1 + t2; \
+	} \
+\
+	for (i = 0; i < 8; i++) \
+	{ \
+		v[i] += H256[i]; \
+		for (l = 0; l < LANES; l++) \
+		{ \
+			unsigned char * p = &digest[l * QSHA256_DIGEST_SIZE + 4 * i]; \
+			p[0] = v[i][l] >> 24; \
+			p[1] = v[i][l] >> 16; \
+			p[2] = v[i][l] >> 8; \
+			p[3] = v[i][l]; \
+		} \
+	} \
+}
+
+typedef uint32_t QShaVec1 __attribute__((vector_size(4)));
+QSHA256_LANES(hash_scalar, QShaVec1, 1, )
+
+#ifdef QSHA256_X86
+
+typedef uint32_t QShaVec4 __attribute__((vector_size(16)));
+typedef uint32_t QShaVec8 __attribute__((vector_size(32)));
+typedef uint32_t QShaVec16 __attribute__((vector_size(64)));
+
+QSHA256_LANES(hash_sse2, QShaVec4, 4, )
+QSHA256_LANES(hash_avx2_lanes, QShaVec8, 8, __attribute__((target("avx2"))))
+QSHA256_LANES(hash_avx512_lanes, QShaVec16, 16, __attribute__((target("avx512f"))))
+
+// gcc does not add vzeroupper on return from target functions, see q_dense.c
+
+__attribute__((target("avx2")))
+static void hash_avx2(const unsigned char * msg, unsigned char * digest)
+{
+	hash_avx2_lanes(msg, digest);
+	_mm256_zeroupper();
+}
+
+__attribute__((target("avx512f")))
+static void hash_avx512(const unsigned char * msg, unsigned char * digest)
+{
+	hash_avx512_lanes(msg, digest);
+	_mm256_zeroupper();
+}
+
+#endif
+
+// the functions of each level. a level is chosen by publishing one pointer
+// into this table, so a reader never sees the lanes of one level with the
+// function of another
+
+typedef struct
+{
+	void (*Lanes)(const unsigned char * msg, unsigned char * digest);
+	int numLanes;
+} QShaImpl;
+
+static const QShaImpl HashImpl[] =
+{
+	{ &hash_scalar, 1 },
+#ifdef QSHA256_X86
+	{ &hash_sse2, 4 },
+	{ &hash_avx2, 8 },
+	{ &hash_avx512, 16 },
+#endif
+};
+
+static const QShaImpl * Hash = NULL;
+
+int qSha256_SetSimdLevel(int level)
+{
+	int best = QSHA256_SCALAR;
+
+#ifdef QSHA256_X86
+	__builtin_cpu_init();
+	best = QSHA256_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		best = QSHA256_AVX2;
+	if (__builtin_cpu_supports("avx512f"))
+		best = QSHA256_AVX512;
+#endif
+	if ((level < 0) || (level > best))
+		level = best;
+	Hash = &HashImpl[level];
+	return level;
+}
+
+// picked by qOracle_setup ahead of the oracles, which hash from several
+// threads at once
+
+int qSha256_GetSimdLevel(void)
+{
+	if (!Hash)
+		qSha256_SetSimdLevel(-1);
+	return Hash - HashImpl;
+}
+
+// full groups of lanes are hashed in place, the last partial group through
+// a zero padded copy
+
+void qSha256_Hash32(const unsigned char * msg, unsigned char * digest, unsigned long num)
+{
+	unsigned char tailMsg[16 * QSHA256_MSG_SIZE];
+	unsigned char tailDigest[16 * QSHA256_DIGEST_SIZE];
+	const QShaImpl * impl;
+	unsigned long n, lanes;
+
+	qSha256_GetSimdLevel();
+	impl = Hash;
+	lanes = impl->numLanes;
+	for (n = 0; n + lanes <= num; n += lanes)
+		impl->Lanes(&msg[n * QSHA256_MSG_SIZE], &digest[n * QSHA256_DIGEST_SIZE]);
+	if (n < num)
+	{
+		memset(tailMsg, 0, sizeof(tailMsg));
+		memcpy(tailMsg, &msg[n * QSHA256_MSG_SIZE], (num - n) * QSHA256_MSG_SIZE);
+		impl->Lanes(tailMsg, tailDigest);
+		memcpy(&digest[n * QSHA256_DIGEST_SIZE], tailDigest, (num - n) * QSHA256_DIGEST_SIZE);
+	}
+}
@@ -0,0 +1,54 @@
+/******************************************
+ * Name: q_sha256.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+
+#ifndef Q_SHA256_H
+#define Q_SHA256_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// SHA-256 of many independent 32 byte messages, each one padded to a single
+// block. the messages are hashed in lanes of one SIMD register, 4 with SSE2,
+// 8 with AVX2 and 16 with AVX-512, picked by qOracle_setup or on first use.
+// qSha256_SetSimdLevel can lower it (-1 selects the best again) and returns
+// the level actually chosen. it is not to be called while hashing
+
+#define QSHA256_SCALAR 0
+#define QSHA256_SSE2 1
+#define QSHA256_AVX2 2
+#define QSHA256_AVX512 3
+
+#define QSHA256_MSG_SIZE 32
+#define QSHA256_DIGEST_SIZE 32
+
+int qSha256_SetSimdLevel(int level);
+int qSha256_GetSimdLevel(void);
+
+// msg holds num messages of QSHA256_MSG_SIZE bytes back to back, digest
+// receives num digests of QSHA256_DIGEST_SIZE bytes
+void qSha256_Hash32(const unsigned char * msg, unsigned char * digest, unsigned long num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
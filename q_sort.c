@@ -0,0 +1,151 @@
+/******************************************
+ * Name: q_sort.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "q_emul.h"
+#include "q_sort.h"
+
+// one pass on digit shift. each chunk counts its own keys, then writes them
+// after the same digit of the chunks before it, which keeps the sort stable
+
+static void radixPass(unsigned long * key, double complex * amp, unsigned long * outKey, double complex * outAmp, unsigned long n, int shift, unsigned long * count, int chunks)
+{
+	unsigned long sum = 0;
+	unsigned long t;
+	int c, d;
+
+	#pragma omp parallel for num_threads(chunks) if (chunks > 1)
+	for (c = 0; c < chunks; c++)
+	{
+		unsigned long * cnt = &count[c * QSORT_RADIX];
+		unsigned long i;
+
+		memset(cnt, 0, QSORT_RADIX * sizeof(unsigned long));
+		for (i = n * c / chunks; i < n * (c + 1) / chunks; i++)
+			cnt[(key[i] >> shift) & (QSORT_RADIX - 1)]++;
+	}
+
+	for (d = 0; d < QSORT_RADIX; d++)
+	{
+		for (c = 0; c < chunks; c++)
+		{
+			t = count[c * QSORT_RADIX + d];
+			count[c * QSORT_RADIX + d] = sum;
+			sum += t;
+		}
+	}
+
+	#pragma omp parallel for num_threads(chunks) if (chunks > 1)
+	for (c = 0; c < chunks; c++)
+	{
+		unsigned long * pos = &count[c * QSORT_RADIX];
+		unsigned long i, j;
+
+		for (i = n * c / chunks; i < n * (c + 1) / chunks; i++)
+		{
+			j = pos[(key[i] >> shift) & (QSORT_RADIX - 1)]++;
+			outKey[j] = key[i];
+			outAmp[j] = amp[i];
+		}
+	}
+}
+
+// sorts n pairs by key. tmpKey and tmpAmp have room for n pairs, the sorted
+// pairs end up in *Key and *Amp, swapping the buffers if needed
+
+void qSort_Radix(unsigned long ** Key, double complex ** Amp, unsigned long ** tmpKey, double complex ** tmpAmp, unsigned long n)
+{
+	unsigned long * key = *Key;
+	unsigned long * count;
+	unsigned long orBits = 0;
+	unsigned long andBits = ~0UL;
+	unsigned long i;
+	unsigned long * swapKey;
+	double complex * swapAmp;
+	int chunks = 1;
+	int shift;
+
+	if (n < 2)
+		return;
+	if (n >= QSORT_PAR_MIN)
+		chunks = qEmul_GetThreads();
+
+	// the digits that differ somewhere
+	#pragma omp parallel for reduction(|:orBits) reduction(&:andBits) num_threads(chunks) if (chunks > 1)
+	for (i = 0; i < n; i++)
+	{
+		orBits |= key[i];
+		andBits &= key[i];
+	}
+
+	count = (unsigned long *) qArena_Alloc(chunks * QSORT_RADIX * sizeof(unsigned long));
+	if (!count)
+	{
+		fprintf(stderr,"Error: unable to malloc radix count\n");
+		exit(-1);
+	}
+	for (shift = 0; shift < 64; shift += QSORT_BITS)
+	{
+		if ((((orBits ^ andBits) >> shift) & (QSORT_RADIX - 1)) == 0)
+			continue;
+		radixPass(*Key, *Amp, *tmpKey, *tmpAmp, n, shift, count, chunks);
+		swapKey = *Key;
+		*Key = *tmpKey;
+		*tmpKey = swapKey;
+		swapAmp = *Amp;
+		*Amp = *tmpAmp;
+		*tmpAmp = swapAmp;
+	}
+	qArena_Free(count);
+}
+
+// adds up the amplitudes of equal keys, in order, and drops the ones that
+// cancel. returns the number of pairs left
+
+unsigned long qSort_Reduce(unsigned long * Key, double complex * Amp, unsigned long n)
+{
+	unsigned long i = 0;
+	unsigned long j = 0;
+	unsigned long Value;
+	double complex Count;
+
+	while (i < n)
+	{
+		Value = Key[i];
+		Count = Amp[i++];
+		while ((i < n) && (Key[i] == Value))
+		{
+			// a sum that cancels starts again, like a cancelled hash slot
+			if (Count == 0)
+				Count = Amp[i++];
+			else
+				Count += Amp[i++];
+		}
+		if (Count != 0)
+		{
+			Key[j] = Value;
+			Amp[j] = Count;
+			j++;
+		}
+	}
+	return j;
+}
@@ -0,0 +1,46 @@
+/******************************************
+ * Name: q_sort.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#ifndef Q_SORT_H
+#define Q_SORT_H
+
+#include <complex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// LSD radix sort of (Value, amplitude) pairs held in a key column and an
+// amplitude column. the sort is stable, so amplitudes emitted for the same
+// Value stay in the order they were emitted in. digits that are the same for
+// every key are skipped
+
+#define QSORT_BITS 8
+#define QSORT_RADIX (1 << QSORT_BITS)
+#define QSORT_PAR_MIN (1UL << 16)   // smaller runs are sorted by one thread
+
+void qSort_Radix(unsigned long ** Key, double complex ** Amp, unsigned long ** tmpKey, double complex ** tmpAmp, unsigned long n);
+unsigned long qSort_Reduce(unsigned long * Key, double complex * Amp, unsigned long n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1199 @@
+/******************************************
+ * Name: q_state.c
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "q_emul.h"
+#include "q_state.h"
+#include "q_arena.h"
+#include "q_sort.h"
+#include <omp.h>
+
+#define QHASH_MIN_SIZE 16
+#define QEMIT_MIN_SIZE 64
+
+static void linkList(QState * block, unsigned long count)
+{
+	unsigned long i;
+
+	for (i = 0; i + 1 < count; i++)
+		block[i].next = &block[i + 1];
+	block[count - 1].next = NULL;
+}
+
+static unsigned long hashSlot(unsigned long Value, unsigned long Size)
+{
+	// fibonacci hashing, Size is a power of 2. the top bits of the product
+	// depend on every bit of Value, the low ones only on its low bits
+	return (Value * 0x9E3779B97F4A7C15) >> (64 - __builtin_ctzl(Size));
+}
+
+// the three columns share one buffer
+
+static void allocSlots(QHash * qHash, unsigned long Size)
+{
+	qHash->Key = (unsigned long *) qArena_Alloc(Size * (sizeof(unsigned long) + sizeof(double complex)));
+	if (!qHash->Key)
+	{
+		fprintf(stderr,"Error: unable to malloc hash slots\n");
+		exit(-1);
+	}
+	qHash->Amp = (double complex *) (qHash->Key + Size);
+	memset(qHash->Key, 0xFF, Size * sizeof(unsigned long));  // QHASH_EMPTY
+	memset(qHash->Amp, 0, Size * sizeof(double complex));
+	qHash->Size = Size;
+	qHash->Used = 0;
+	qHash->Live = 0;
+}
+
+void qState_HashInit(QHash * qHash, unsigned long hint)
+{
+	unsigned long Size = QHASH_MIN_SIZE;
+
+	// keep the load factor at or below 1/2
+	while (Size < hint * 2)
+		Size <<= 1;
+	allocSlots(qHash, Size);
+}
+
+void qState_HashFree(QHash * qHash)
+{
+	qArena_Free(qHash->Key);
+	qHash->Key = NULL;
+	qHash->Amp = NULL;
+	qHash->Size = 0;
+	qHash->Used = 0;
+	qHash->Live = 0;
+}
+
+static void growHash(QHash * qHash)
+{
+	QHash oldHash = *qHash;
+	unsigned long i;
+
+	allocSlots(qHash, oldHash.Size * 2);
+	for (i = 0; i < oldHash.Size; i++)
+	{
+		// cancelled keys are not carried over
+		if (QHASH_LIVE(&oldHash, i))
+			qState_HashAdd(qHash, oldHash.Key[i], oldHash.Amp[i]);
+	}
+	qArena_Free(oldHash.Key);
+}
+
+void qState_HashAdd(QHash * qHash, unsigned long Value, double complex Count)
+{
+	unsigned long i;
+
+	if ((qHash->Used + 1) * 2 > qHash->Size)
+		growHash(qHash);
+
+	i = hashSlot(Value, qHash->Size);
+	while ((qHash->Key[i] != QHASH_EMPTY) && (qHash->Key[i] != Value))
+		i = (i + 1) & (qHash->Size - 1);
+
+	if (qHash->Key[i] == QHASH_EMPTY)
+	{
+		if (Count == 0)
+			return;
+		qHash->Key[i] = Value;
+		qHash->Amp[i] = Count;
+		qHash->Used++;
+		qHash->Live++;
+	}
+	else if (qHash->Amp[i] == 0)
+	{
+		qHash->Amp[i] = Count;
+		if (Count != 0)
+			qHash->Live++;
+	}
+	else
+	{
+		qHash->Amp[i] += Count;
+		if (qHash->Amp[i] == 0) // cancelled out
+			qHash->Live--;
+	}
+}
+
+// the slot holding Value, or QHASH_EMPTY
+
+unsigned long qState_HashFind(QHash * qHash, unsigned long Value)
+{
+	unsigned long i = hashSlot(Value, qHash->Size);
+
+	while (qHash->Key[i] != QHASH_EMPTY)
+	{
+		if (qHash->Key[i] == Value)
+			return i;
+		i = (i + 1) & (qHash->Size - 1);
+	}
+	return QHASH_EMPTY;
+}
+
+void qState_HashFromList(QHash * qHash, QState * qList)
+{
+	QState * temp;
+	unsigned long count = 0;
+
+	for (temp = qList; temp; temp = temp->next)
+		count++;
+	qState_HashInit(qHash, count);
+	for (temp = qList; temp; temp = temp->next)
+		qState_HashAdd(qHash, temp->Value, temp->Count);
+}
+
+static int compareValue(const void * a, const void * b)
+{
+	unsigned long va = (*(QState **) a)->Value;
+	unsigned long vb = (*(QState **) b)->Value;
+
+	return (va > vb) - (va < vb);
+}
+
+// copies the live slots into consecutive nodes
+
+static unsigned long collectLive(QHash * qHash, QState * node)
+{
+	unsigned long i;
+	unsigned long j = 0;
+
+	for (i = 0; i < qHash->Size; i++)
+	{
+		if (QHASH_LIVE(qHash, i))
+		{
+			node[j].Value = qHash->Key[i];
+			node[j].Count = qHash->Amp[i];
+			j++;
+		}
+	}
+	return j;
+}
+
+// an exported list is one block of nodes chained in order, so that
+// qEmul_FreeList can hand the whole list back to the arena at once. the
+// caller fills in the nodes and chains them. the blocks out are recorded,
+// only a few lists are alive at a time
+
+static QState ** ListBlocks = NULL;
+static unsigned long numListBlocks = 0;
+static unsigned long sizeListBlocks = 0;
+
+QState * qState_ListAlloc(unsigned long count)
+{
+	QState * block;
+	QState ** blocks;
+
+	if (count == 0)
+		return NULL;
+	block = (QState *) qArena_Alloc(count * sizeof(QState));
+	if (numListBlocks == sizeListBlocks)
+	{
+		sizeListBlocks = sizeListBlocks ? 2 * sizeListBlocks : 16;
+		blocks = (QState **) realloc(ListBlocks, sizeListBlocks * sizeof(QState *));
+		if (blocks)
+			ListBlocks = blocks;
+		else
+			block = NULL;
+	}
+	if (!block)
+	{
+		fprintf(stderr,"Error: unable to malloc\n");
+		exit(-1);
+	}
+	ListBlocks[numListBlocks++] = block;
+	return block;
+}
+
+// gives back qList if it is a block of qState_ListAlloc, and returns 0 when
+// it is not
+
+int qState_ListFree(QState * qList)
+{
+	unsigned long i;
+
+	for (i = numListBlocks; i > 0; i--)
+	{
+		if (ListBlocks[i - 1] == qList)
+		{
+			ListBlocks[i - 1] = ListBlocks[--numListBlocks];
+			qArena_Free(qList);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// sorts the nodes collected in scratch into a new list. the ranges between
+// start[] are each sorted on their own, it is up to the caller to have them
+// in increasing order of Value
+
+static void sortToList(QState * scratch, unsigned long * start, int numRanges, QState ** qList)
+{
+	QState ** order;
+	QState * node;
+	unsigned long i, j = start[numRanges];
+	int r;
+
+	order = (QState **) qArena_Alloc(j * sizeof(QState *));
+	if (!order)
+	{
+		fprintf(stderr,"Error: unable to malloc hash order\n");
+		exit(-1);
+	}
+	for (i = 0; i < j; i++)
+		order[i] = &scratch[i];
+
+	// pointers are quicker to move around than the nodes
+	#pragma omp parallel for schedule(dynamic) num_threads(qEmul_GetThreads()) if (numRanges > 1)
+	for (r = 0; r < numRanges; r++)
+		qsort(&order[start[r]], start[r + 1] - start[r], sizeof(QState *), compareValue);
+
+	// values beyond the register wrap around the shards
+	for (i = 1; i < j; i++)
+	{
+		if (order[i - 1]->Value > order[i]->Value)
+		{
+			qsort(order, j, sizeof(QState *), compareValue);
+			break;
+		}
+	}
+
+	*qList = node = qState_ListAlloc(j);
+	for (i = 0; i < j; i++)
+	{
+		node[i].Value = order[i]->Value;
+		node[i].Count = order[i]->Count;
+	}
+	linkList(node, j);
+	qArena_Free(order);
+}
+
+static QState * allocScratch(unsigned long count)
+{
+	QState * scratch;
+
+	scratch = (QState *) qArena_Alloc(count * sizeof(QState));
+	if (!scratch)
+	{
+		fprintf(stderr,"Error: unable to malloc list scratch\n");
+		exit(-1);
+	}
+	return scratch;
+}
+
+// the ordered view: builds the sorted list expected by qEmul_PrintList and qEmul_Write
+
+void qState_HashToList(QHash * qHash, QState ** qList)
+{
+	QState * scratch;
+	unsigned long start[2];
+
+	*qList = NULL;
+	if (qHash->Live == 0)
+		return;
+	scratch = allocScratch(qHash->Live);
+	start[0] = 0;
+	start[1] = collectLive(qHash, scratch);
+	sortToList(scratch, start, 1, qList);
+	qArena_Free(scratch);
+}
+
+static void initShards(QStore * qStore, int shardBits, unsigned long hint)
+{
+	int i;
+
+	if (shardBits > qStore->numQubits)
+		shardBits = qStore->numQubits;
+	qStore->ShardBits = shardBits;
+	qStore->ShardShift = qStore->numQubits - shardBits;
+	qStore->Hash = (QHash *) qArena_Alloc(sizeof(QHash) << shardBits);
+	if (!qStore->Hash)
+	{
+		fprintf(stderr,"Error: unable to malloc hash shards\n");
+		exit(-1);
+	}
+	for (i = 0; i < (1 << shardBits); i++)
+		qState_HashInit(&(qStore->Hash[i]), hint >> shardBits);
+}
+
+static void freeShards(QStore * qStore)
+{
+	int i;
+
+	for (i = 0; i < (1 << qStore->ShardBits); i++)
+		qState_HashFree(&(qStore->Hash[i]));
+	qArena_Free(qStore->Hash);
+	qStore->Hash = NULL;
+}
+
+static void clearStore(QStore * qStore, int numQubits)
+{
+	qStore->numQubits = numQubits;
+	qStore->Dense = 0;
+	qStore->Sorted = 0;
+	qStore->Amp = NULL;
+	qStore->Key = NULL;
+	qStore->Live = 0;
+	qStore->Hash = NULL;
+	qStore->ShardBits = 0;
+	qStore->ShardShift = numQubits;
+	qStore->Emit = NULL;
+	qStore->numEmit = 0;
+	qStore->Totals = 0;
+}
+
+void qState_StoreInit(QStore * qStore, int numQubits, unsigned long hint, int dense)
+{
+	clearStore(qStore, numQubits);
+	if (dense && (numQubits <= QDENSE_MAX_QUBITS))
+	{
+		qStore->Amp = (double complex *) qArena_Calloc((1UL << numQubits) * sizeof(double complex));
+		if (qStore->Amp)
+		{
+			qStore->Dense = 1;
+			return;
+		}
+		// not enough memory for the dense array, stay sparse
+	}
+	initShards(qStore, qState_StoreWantShards(numQubits, hint), hint);
+}
+
+// a sparse store with a given layout, used when the next step has to be
+// sharded the same way as the current one
+
+void qState_StoreInitShards(QStore * qStore, int numQubits, unsigned long hint, int shardBits)
+{
+	clearStore(qStore, numQubits);
+	initShards(qStore, shardBits, hint);
+}
+
+// a run of pairs, the Key column and the Amp column share one buffer
+
+static unsigned long * allocRun(unsigned long Size, double complex ** Amp)
+{
+	unsigned long * Key;
+
+	// even, so that Amp stays aligned
+	Size = (Size < QEMIT_MIN_SIZE) ? QEMIT_MIN_SIZE : (Size + 1) & ~1UL;
+	Key = (unsigned long *) qArena_Alloc(Size * (sizeof(unsigned long) + sizeof(double complex)));
+	if (!Key)
+	{
+		fprintf(stderr,"Error: unable to malloc sorted run\n");
+		exit(-1);
+	}
+	*Amp = (double complex *) (Key + Size);
+	return Key;
+}
+
+// an empty sorted store, filled through qState_StoreAdd from up to
+// qEmul_GetThreads() threads at once and then qState_StoreSettle
+
+void qState_StoreInitSorted(QStore * qStore, int numQubits, unsigned long hint)
+{
+	QEmit * e;
+	int t;
+
+	clearStore(qStore, numQubits);
+	qStore->Sorted = 1;
+	qStore->numEmit = qEmul_GetThreads();
+	qStore->Emit = (QEmit *) qArena_Alloc(qStore->numEmit * sizeof(QEmit));
+	if (!qStore->Emit)
+	{
+		fprintf(stderr,"Error: unable to malloc emit buffers\n");
+		exit(-1);
+	}
+	for (t = 0; t < qStore->numEmit; t++)
+	{
+		e = &(qStore->Emit[t]);
+		e->Size = (hint / qStore->numEmit < QEMIT_MIN_SIZE) ? QEMIT_MIN_SIZE : hint / qStore->numEmit;
+		e->Key = allocRun(e->Size, &(e->Amp));
+		e->Num = 0;
+	}
+}
+
+static void emitAdd(QEmit * e, unsigned long Value, double complex Count)
+{
+	unsigned long * Key;
+	double complex * Amp;
+
+	if (Count == 0)
+		return;
+	if (e->Num == e->Size)
+	{
+		Key = allocRun(e->Size * 2, &Amp);
+		memcpy(Key, e->Key, e->Num * sizeof(unsigned long));
+		memcpy(Amp, e->Amp, e->Num * sizeof(double complex));
+		qArena_Free(e->Key);
+		e->Key = Key;
+		e->Amp = Amp;
+		e->Size *= 2;
+	}
+	e->Key[e->Num] = Value;
+	e->Amp[e->Num] = Count;
+	e->Num++;
+}
+
+// sorts and reduces what the threads emitted. the buffers are taken in thread
+// order, so equal values are added up in the order they were emitted
+
+void qState_StoreSettle(QStore * qStore)
+{
+	unsigned long * Key, * tmpKey;
+	double complex * Amp, * tmpAmp;
+	unsigned long n = 0;
+	int t;
+
+	if (!qStore->Emit)
+		return;
+	for (t = 0; t < qStore->numEmit; t++)
+		n += qStore->Emit[t].Num;
+	if (qStore->numEmit == 1)
+	{
+		Key = qStore->Emit[0].Key;
+		Amp = qStore->Emit[0].Amp;
+	}
+	else
+	{
+		Key = allocRun(n, &Amp);
+		n = 0;
+		for (t = 0; t < qStore->numEmit; t++)
+		{
+			memcpy(&Key[n], qStore->Emit[t].Key, qStore->Emit[t].Num * sizeof(unsigned long));
+			memcpy(&Amp[n], qStore->Emit[t].Amp, qStore->Emit[t].Num * sizeof(double complex));
+			n += qStore->Emit[t].Num;
+			qArena_Free(qStore->Emit[t].Key);
+		}
+	}
+	qArena_Free(qStore->Emit);
+	qStore->Emit = NULL;
+	qStore->numEmit = 0;
+
+	tmpKey = allocRun(n, &tmpAmp);
+	qSort_Radix(&Key, &Amp, &tmpKey, &tmpAmp, n);
+	qArena_Free(tmpKey);
+	qStore->Key = Key;
+	qStore->Amp = Amp;
+	qStore->Live = qSort_Reduce(Key, Amp, n);
+	qStore->Totals = 0;
+}
+
+void qState_StoreFree(QStore * qStore)
+{
+	int t;
+
+	if (qStore->Sorted)
+	{
+		for (t = 0; t < qStore->numEmit; t++)
+			qArena_Free(qStore->Emit[t].Key);
+		qArena_Free(qStore->Emit);
+		qArena_Free(qStore->Key);
+		clearStore(qStore, qStore->numQubits);
+	}
+	else if (qStore->Dense)
+	{
+		qArena_Free(qStore->Amp);
+		qStore->Amp = NULL;
+		qStore->Live = 0;
+	}
+	else
+		freeShards(qStore);
+}
+
+static void storeToSparse(QStore * qStore)
+{
+	double complex * Amp = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long i;
+
+	initShards(qStore, qState_StoreWantShards(qStore->numQubits, qStore->Live), qStore->Live);
+	for (i = 0; i < Size; i++)
+	{
+		if (Amp[i] != 0)
+			qState_HashAdd(&(qStore->Hash[QSTORE_SHARD(qStore, i)]), i, Amp[i]);
+	}
+	qArena_Free(Amp);
+	qStore->Amp = NULL;
+	qStore->Live = 0;
+	qStore->Dense = 0;
+	qStore->Totals = 0;
+}
+
+// the dense array is already in Value order
+
+static void storeToSorted(QStore * qStore)
+{
+	double complex * dense = qStore->Amp;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long i, j = 0;
+
+	qStore->Key = allocRun(qStore->Live, &(qStore->Amp));
+	for (i = 0; (i < Size) && (j < qStore->Live); i++)
+	{
+		if (dense[i] != 0)
+		{
+			qStore->Key[j] = i;
+			qStore->Amp[j] = dense[i];
+			j++;
+		}
+	}
+	qArena_Free(dense);
+	qStore->Live = j;
+	qStore->Dense = 0;
+	qStore->Sorted = 1;
+	qStore->Totals = 0;
+}
+
+static void storeToDense(QStore * qStore)
+{
+	QHash * qHash;
+	unsigned long Size = 1UL << qStore->numQubits;
+	unsigned long i;
+	int s;
+
+	if (qStore->Sorted)
+	{
+		double complex * Amp = (double complex *) qArena_Calloc(Size * sizeof(double complex));
+
+		if (!Amp)
+			return;
+		for (i = 0; i < qStore->Live; i++)
+			Amp[qStore->Key[i]] = qStore->Amp[i];
+		qArena_Free(qStore->Key);
+		qStore->Key = NULL;
+		qStore->Amp = Amp;
+		qStore->Sorted = 0;
+		qStore->Dense = 1;
+		qStore->Totals = 0;
+		return;
+	}
+	qStore->Amp = (double complex *) qArena_Calloc(Size * sizeof(double complex));
+	if (!qStore->Amp)
+		return;
+	qStore->Live = qState_StoreLive(qStore);
+	for (s = 0; s < (1 << qStore->ShardBits); s++)
+	{
+		qHash = &(qStore->Hash[s]);
+		for (i = 0; i < qHash->Size; i++)
+		{
+			if (QHASH_LIVE(qHash, i))
+				qStore->Amp[qHash->Key[i]] = qHash->Amp[i];
+		}
+	}
+	freeShards(qStore);
+	qStore->Dense = 1;
+	qStore->Totals = 0;
+}
+
+// switches to the dense array ahead of a step that is expected to fill it
+
+int qState_StoreMakeDense(QStore * qStore)
+{
+	if (!qStore->Dense && (qStore->numQubits <= QDENSE_MAX_QUBITS))
+		storeToDense(qStore);
+	return qStore->Dense;
+}
+
+// moves hash tables into a sorted store, so a step that emits from it goes
+// through the entries in Value order, as the sums of its outputs depend on it
+
+void qState_StoreMakeSorted(QStore * qStore)
+{
+	QHash * qHash;
+	unsigned long * Key, * tmpKey;
+	double complex * Amp, * tmpAmp;
+	unsigned long i, n = 0;
+	int s;
+
+	if (qStore->Dense || qStore->Sorted)
+		return;
+	Key = allocRun(qState_StoreLive(qStore), &Amp);
+	for (s = 0; s < (1 << qStore->ShardBits); s++)
+	{
+		qHash = &(qStore->Hash[s]);
+		for (i = 0; i < qHash->Size; i++)
+		{
+			if (QHASH_LIVE(qHash, i))
+			{
+				Key[n] = qHash->Key[i];
+				Amp[n] = qHash->Amp[i];
+				n++;
+			}
+		}
+	}
+	freeShards(qStore);
+	tmpKey = allocRun(n, &tmpAmp);
+	qSort_Radix(&Key, &Amp, &tmpKey, &tmpAmp, n);
+	qArena_Free(tmpKey);
+	clearStore(qStore, qStore->numQubits);
+	qStore->Sorted = 1;
+	qStore->Key = Key;
+	qStore->Amp = Amp;
+	qStore->Live = n;
+}
+
+// moves a sorted store into hash tables, for the steps that look up entries
+// of the current state while writing the next one
+
+void qState_StoreMakeHash(QStore * qStore)
+{
+	unsigned long * Key = qStore->Key;
+	double complex * Amp = qStore->Amp;
+	unsigned long n = qStore->Live;
+	unsigned long i;
+
+	if (!qStore->Sorted)
+		return;
+	clearStore(qStore, qStore->numQubits);
+	initShards(qStore, qState_StoreWantShards(qStore->numQubits, n), n);
+	for (i = 0; i < n; i++)
+		qState_StoreAdd(qStore, Key[i], Amp[i]);
+	qArena_Free(Key);
+}
+
+static void storeReshard(QStore * qStore, int shardBits)
+{
+	QStore newStore;
+	QHash * qHash;
+	unsigned long i;
+	int s;
+
+	qState_StoreInitShards(&newStore, qStore->numQubits, qState_StoreLive(qStore), shardBits);
+	for (s = 0; s < (1 << qStore->ShardBits); s++)
+	{
+		qHash = &(qStore->Hash[s]);
+		for (i = 0; i < qHash->Size; i++)
+		{
+			if (QHASH_LIVE(qHash, i))
+				qState_StoreAdd(&newStore, qHash->Key[i], qHash->Amp[i]);
+		}
+	}
+	freeShards(qStore);
+	*qStore = newStore;
+}
+
+void qState_StoreAdd(QStore * qStore, unsigned long Value, double complex Count)
+{
+	double complex * amp;
+
+	if (qStore->Sorted)
+	{
+		// one buffer per thread, see qState_StoreInitSorted
+		emitAdd(&(qStore->Emit[omp_get_thread_num()]), Value, Count);
+		return;
+	}
+	if (!qStore->Dense)
+	{
+		qState_HashAdd(&(qStore->Hash[QSTORE_SHARD(qStore, Value)]), Value, Count);
+		return;
+	}
+	if (Value >> qStore->numQubits)
+	{
+		// outside of the register, can only be kept in the hash table
+		storeToSparse(qStore);
+		qState_HashAdd(&(qStore->Hash[QSTORE_SHARD(qStore, Value)]), Value, Count);
+		return;
+	}
+	amp = &(qStore->Amp[Value]);
+	if (*amp == 0)
+	{
+		*amp = Count;
+		if (Count != 0)
+			qStore->Live++;
+	}
+	else
+	{
+		*amp += Count;
+		if (*amp == 0) // cancelled out
+			qStore->Live--;
+	}
+}
+
+// binary search of a sorted store, the index of Value or QHASH_EMPTY
+
+static unsigned long sortedFind(QStore * qStore, unsigned long Value)
+{
+	unsigned long lo = 0;
+	unsigned long hi = qStore->Live;
+	unsigned long mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (qStore->Key[mid] < Value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if ((lo < qStore->Live) && (qStore->Key[lo] == Value))
+		return lo;
+	return QHASH_EMPTY;
+}
+
+// reads the amplitude of Value, returns 0 if it is not live
+
+int qState_StoreGet(QStore * qStore, unsigned long Value, double complex * Count)
+{
+	QHash * qHash;
+	unsigned long i;
+
+	if (qStore->Dense)
+	{
+		*Count = (Value >> qStore->numQubits) ? 0 : qStore->Amp[Value];
+		return (*Count != 0);
+	}
+	if (qStore->Sorted)
+	{
+		i = sortedFind(qStore, Value);
+		*Count = (i == QHASH_EMPTY) ? 0 : qStore->Amp[i];
+		return (*Count != 0);
+	}
+	qHash = &(qStore->Hash[QSTORE_SHARD(qStore, Value)]);
+	i = qState_HashFind(qHash, Value);
+	*Count = (i == QHASH_EMPTY) ? 0 : qHash->Amp[i];
+	return (*Count != 0);
+}
+
+// same, and leaves a 0 amplitude behind. Live is not updated, this is for
+// draining a store that is about to be freed
+
+int qState_StoreTake(QStore * qStore, unsigned long Value, double complex * Count)
+{
+	QHash * qHash;
+	unsigned long i;
+
+	if (qStore->Dense)
+	{
+		if (Value >> qStore->numQubits)
+			*Count = 0;
+		else
+		{
+			*Count = qStore->Amp[Value];
+			qStore->Amp[Value] = 0;
+		}
+		return (*Count != 0);
+	}
+	if (qStore->Sorted)
+	{
+		i = sortedFind(qStore, Value);
+		*Count = (i == QHASH_EMPTY) ? 0 : qStore->Amp[i];
+		if (i != QHASH_EMPTY)
+			qStore->Amp[i] = 0;
+		return (*Count != 0);
+	}
+	qHash = &(qStore->Hash[QSTORE_SHARD(qStore, Value)]);
+	i = qState_HashFind(qHash, Value);
+	if (i == QHASH_EMPTY)
+	{
+		*Count = 0;
+		return 0;
+	}
+	*Count = qHash->Amp[i];
+	qHash->Amp[i] = 0;
+	return (*Count != 0);
+}
+
+// keeps only the entries with (Value & mask) == match, in place. the sparse
+// tables are filtered with a straight pass over the Key column. the totals of
+// what is kept are added up on the way, in the order qState_StoreCount2 would
+
+void qState_StoreFilter(QStore * qStore, unsigned long mask, unsigned long match)
+{
+	QHash * qHash;
+	double * a;  // re, im pairs
+	unsigned long i, live;
+	double norm2 = 0;
+	double absSum = 0;
+	int s;
+
+	if (qStore->Dense)
+	{
+		live = 0;
+		for (i = 0; i < (1UL << qStore->numQubits); i++)
+		{
+			if ((i & mask) != match)
+				qStore->Amp[i] = 0;
+			live += (qStore->Amp[i] != 0);
+			norm2 += fabs(creal(qStore->Amp[i])*creal(qStore->Amp[i]) - cimag(qStore->Amp[i])*cimag(qStore->Amp[i]));
+			absSum += fabs(creal(qStore->Amp[i]));
+			absSum += fabs(cimag(qStore->Amp[i]));
+		}
+		qStore->Live = live;
+	}
+	else if (qStore->Sorted)
+	{
+		live = 0;
+		a = (double *) qStore->Amp;
+		for (i = 0; i < qStore->Live; i++)
+		{
+			qStore->Key[live] = qStore->Key[i];
+			qStore->Amp[live] = qStore->Amp[i];
+			if (((qStore->Key[i] & mask) != match) || (qStore->Amp[i] == 0))
+				continue;
+			norm2 += fabs(a[2*live]*a[2*live] - a[2*live + 1]*a[2*live + 1]);
+			absSum += fabs(a[2*live]);
+			absSum += fabs(a[2*live + 1]);
+			live++;
+		}
+		qStore->Live = live;
+	}
+	else
+	{
+		for (s = 0; s < (1 << qStore->ShardBits); s++)
+		{
+			qHash = &(qStore->Hash[s]);
+			a = (double *) qHash->Amp;
+			live = 0;
+			for (i = 0; i < qHash->Size; i++)
+			{
+				if ((qHash->Key[i] & mask) != match)
+					qHash->Amp[i] = 0;
+				live += QHASH_LIVE(qHash, i);
+				norm2 += fabs(a[2*i]*a[2*i] - a[2*i + 1]*a[2*i + 1]);
+				absSum += fabs(a[2*i]);
+				absSum += fabs(a[2*i + 1]);
+			}
+			qHash->Live = live;
+		}
+	}
+	qStore->Norm2 = norm2;
+	qStore->AbsSum = absSum;
+	qStore->Totals = 1;
+}
+
+// iterates over the live entries, in Value order when dense. for a sparse
+// store the shard is kept in the top bits of pos
+
+#define QSTORE_POS_SHIFT 48
+
+int qState_StoreNext(QStore * qStore, unsigned long * pos, QState * entry)
+{
+	unsigned long i = *pos;
+
+	if (qStore->Dense)
+	{
+		unsigned long Size = 1UL << qStore->numQubits;
+
+		while ((i < Size) && (qStore->Amp[i] == 0))
+			i++;
+		if (i >= Size)
+			return 0;
+		entry->Value = i;
+		entry->Count = qStore->Amp[i];
+	}
+	else if (qStore->Sorted)
+	{
+		while ((i < qStore->Live) && (qStore->Amp[i] == 0))
+			i++;
+		if (i >= qStore->Live)
+			return 0;
+		entry->Value = qStore->Key[i];
+		entry->Count = qStore->Amp[i];
+	}
+	else
+	{
+		unsigned long s = i >> QSTORE_POS_SHIFT;
+		QHash * qHash;
+
+		i &= (1UL << QSTORE_POS_SHIFT) - 1;
+		while (1)
+		{
+			if (s >= (1UL << qStore->ShardBits))
+				return 0;
+			qHash = &(qStore->Hash[s]);
+			while ((i < qHash->Size) && !QHASH_LIVE(qHash, i))
+				i++;
+			if (i < qHash->Size)
+				break;
+			s++;
+			i = 0;
+		}
+		entry->Value = qHash->Key[i];
+		entry->Count = qHash->Amp[i];
+		i |= s << QSTORE_POS_SHIFT;
+	}
+	entry->next = NULL;
+	*pos = i + 1;
+	return 1;
+}
+
+unsigned long qState_StoreLive(QStore * qStore)
+{
+	unsigned long live = 0;
+	int s;
+
+	if (qStore->Dense || qStore->Sorted)
+		return qStore->Live;
+	for (s = 0; s < (1 << qStore->ShardBits); s++)
+		live += qStore->Hash[s].Live;
+	return live;
+}
+
+int qState_StoreWantDense(int numQubits, unsigned long live)
+{
+	if (numQubits > QDENSE_MAX_QUBITS)
+		return 0;
+	return (live * QDENSE_ENTER >= (1UL << numQubits));
+}
+
+// about 4 shards per thread, so uneven shards still spread over the threads
+
+int qState_StoreWantShards(int numQubits, unsigned long live)
+{
+	int threads = qEmul_GetThreads();
+	int bits = 0;
+
+	if ((threads <= 1) || (live < QSHARD_MIN_LIVE))
+		return 0;
+	while (((1 << bits) < threads * 4) && (bits < QSHARD_MAX_BITS))
+		bits++;
+	if (bits > numQubits)
+		bits = numQubits;
+	return bits;
+}
+
+void qState_StoreBalance(QStore * qStore)
+{
+	unsigned long live = qState_StoreLive(qStore);
+	int shardBits;
+
+	if (qStore->Dense)
+	{
+		if (live * QDENSE_LEAVE < (1UL << qStore->numQubits))
+			storeToSorted(qStore);
+	}
+	else if (qState_StoreWantDense(qStore->numQubits, live))
+		storeToDense(qStore);
+	else if (!qStore->Sorted)
+	{
+		// only ever split further, a shrinking state keeps its layout
+		shardBits = qState_StoreWantShards(qStore->numQubits, live);
+		if (shardBits > qStore->ShardBits)
+			storeReshard(qStore, shardBits);
+	}
+}
+
+// the lists made by qEmul are in increasing Value order and are copied
+// straight into a sorted store
+
+void qState_StoreFromList(QStore * qStore, int numQubits, QState * qList)
+{
+	QState * temp;
+	unsigned long count = 0;
+	int sorted = 1;
+
+	for (temp = qList; temp; temp = temp->next)
+	{
+		if (temp->next && (temp->next->Value <= temp->Value))
+			sorted = 0;
+		count++;
+	}
+	if (sorted && !qState_StoreWantDense(numQubits, count))
+	{
+		clearStore(qStore, numQubits);
+		qStore->Sorted = 1;
+		qStore->Key = allocRun(count, &(qStore->Amp));
+		for (temp = qList; temp; temp = temp->next)
+		{
+			if (temp->Count == 0)
+				continue;
+			qStore->Key[qStore->Live] = temp->Value;
+			qStore->Amp[qStore->Live] = temp->Count;
+			qStore->Live++;
+		}
+		return;
+	}
+	qState_StoreInit(qStore, numQubits, count, qState_StoreWantDense(numQubits, count));
+	for (temp = qList; temp; temp = temp->next)
+		qState_StoreAdd(qStore, temp->Value, temp->Count);
+}
+
+static void shardsToList(QStore * qStore, QState ** qList)
+{
+	QState * scratch;
+	unsigned long * start;
+	unsigned long j;
+	int s;
+	int numShards = 1 << qStore->ShardBits;
+
+	*qList = NULL;
+	j = qState_StoreLive(qStore);
+	if (j == 0)
+		return;
+	scratch = allocScratch(j);
+	start = (unsigned long *) qArena_Alloc((numShards + 1) * sizeof(unsigned long));
+	if (!start)
+	{
+		fprintf(stderr,"Error: unable to malloc shard order\n");
+		exit(-1);
+	}
+	j = 0;
+	for (s = 0; s < numShards; s++)
+	{
+		start[s] = j;
+		j += collectLive(&(qStore->Hash[s]), &scratch[j]);
+	}
+	start[numShards] = j;
+
+	// shards hold increasing ranges of Value, so sorting each one is enough
+	sortToList(scratch, start, numShards, qList);
+	qArena_Free(start);
+	qArena_Free(scratch);
+}
+
+void qState_StoreToList(QStore * qStore, QState ** qList)
+{
+	QState * temp;
+	unsigned long i, j, count;
+
+	if (qStore->Sorted)
+	{
+		*qList = temp = qState_ListAlloc(qStore->Live);
+		j = 0;
+		for (i = 0; i < qStore->Live; i++)
+		{
+			if (qStore->Amp[i] == 0)
+				continue;
+			temp[j].Value = qStore->Key[i];
+			temp[j].Count = qStore->Amp[i];
+			j++;
+		}
+		if (j > 0)
+			linkList(temp, j);
+		else
+		{
+			qArena_Free(temp);
+			*qList = NULL;
+		}
+		return;
+	}
+	if (!qStore->Dense)
+	{
+		shardsToList(qStore, qList);
+		return;
+	}
+
+	// the dense array is already in Value order
+	count = 0;
+	for (i = 0; i < (1UL << qStore->numQubits); i++)
+		count += (qStore->Amp[i] != 0);
+	*qList = temp = qState_ListAlloc(count);
+	j = 0;
+	for (i = 0; j < count; i++)
+	{
+		if (qStore->Amp[i] == 0)
+			continue;
+		temp[j].Value = i;
+		temp[j].Count = qStore->Amp[i];
+		j++;
+	}
+	if (count > 0)
+		linkList(temp, count);
+}
+
+// both totals in one pass. they are kept in the store until a step changes
+// it, so a run of measurements only pays for the first one
+
+static void storeTotals(QStore * qStore)
+{
+	QHash * qHash;
+	double * a;  // re, im pairs
+	unsigned long i, n;
+	double norm2 = 0;
+	double absSum = 0;
+	int s;
+
+	if (qStore->Totals)
+		return;
+	if (qStore->Dense)
+	{
+		for (i = 0; i < (1UL << qStore->numQubits); i++)
+		{
+			norm2 += fabs(creal(qStore->Amp[i])*creal(qStore->Amp[i]) - cimag(qStore->Amp[i])*cimag(qStore->Amp[i]));
+			absSum += fabs(creal(qStore->Amp[i]));
+			absSum += fabs(cimag(qStore->Amp[i]));
+		}
+	}
+	else if (qStore->Sorted)
+	{
+		a = (double *) qStore->Amp;
+		n = 2 * qStore->Live;
+		for (i = 0; i < n; i += 2)
+		{
+			norm2 += fabs(a[i]*a[i] - a[i + 1]*a[i + 1]);
+			absSum += fabs(a[i]);
+			absSum += fabs(a[i + 1]);
+		}
+	}
+	else
+	{
+		// empty and cancelled slots hold 0, so every slot can be summed
+		for (s = 0; s < (1 << qStore->ShardBits); s++)
+		{
+			qHash = &(qStore->Hash[s]);
+			a = (double *) qHash->Amp;
+			n = 2 * qHash->Size;
+			for (i = 0; i < n; i += 2)
+			{
+				norm2 += fabs(a[i]*a[i] - a[i + 1]*a[i + 1]);
+				absSum += fabs(a[i]);
+				absSum += fabs(a[i + 1]);
+			}
+		}
+	}
+	qStore->Norm2 = norm2;
+	qStore->AbsSum = absSum;
+	qStore->Totals = 1;
+}
+
+// same measure as qEmul_Count2List, whose fabs of Count*Count takes the real
+// part of the square: |re*re - im*im| summed over the entries
+
+double qState_StoreCount2(QStore * qStore)
+{
+	storeTotals(qStore);
+	return qStore->Norm2;
+}
+
+double qState_StoreAbsSum(QStore * qStore)
+{
+	storeTotals(qStore);
+	return qStore->AbsSum;
+}
+
+// walks the entries until the |re|+|im| weights used up reach chosen
+
+unsigned long qState_StorePick(QStore * qStore, double chosen)
+{
+	QState entry;
+	unsigned long pos = 0;
+	unsigned long Value = 0;
+
+	while (qState_StoreNext(qStore, &pos, &entry))
+	{
+		Value = entry.Value;
+		if ((chosen - fabs(creal(entry.Count)) - fabs(cimag(entry.Count))) <= 0)
+			break;
+		chosen -= fabs(creal(entry.Count));
+		chosen -= fabs(cimag(entry.Count));
+	}
+	return Value;
+}
@@ -0,0 +1,140 @@
+/******************************************
+ * Name: q_state.h
+ *
+ * Author: Tan Teik Guan
+ *
+ * Copyright (c) 2020 Tan Teik Guan.
+ * All rights reserved.
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by Tan Teik Guan. The name of
+ * Tan Teik Guan may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *****************************************/
+
+#ifndef Q_STATE_H
+#define Q_STATE_H
+
+#include <complex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _QState;
+
+// open addressing hash table of amplitudes keyed by Value, kept as a Key
+// column and an Amp column (re, im pairs like the dense array) so that mask
+// tests and sums stream over plain arrays.
+// slots with Key == QHASH_EMPTY are unused and hold a 0 amplitude. a slot
+// whose amplitude cancels to 0 keeps its key, but is skipped when iterating,
+// just like InsertInList dropping the node
+
+#define QHASH_EMPTY 0xFFFFFFFFFFFFFFFF
+
+typedef struct _QHash
+{
+  unsigned long * Key;
+  double complex * Amp;    // 0 in empty slots
+  unsigned long Size;      // number of slots, always a power of 2
+  unsigned long Used;      // slots holding a key
+  unsigned long Live;      // slots holding a non-zero amplitude
+} QHash;
+
+void qState_HashInit(QHash * qHash, unsigned long hint);
+void qState_HashFree(QHash * qHash);
+void qState_HashAdd(QHash * qHash, unsigned long Value, double complex Count);
+unsigned long qState_HashFind(QHash * qHash, unsigned long Value);
+void qState_HashFromList(QHash * qHash, struct _QState * qList);
+void qState_HashToList(QHash * qHash, struct _QState ** qList);
+struct _QState * qState_ListAlloc(unsigned long count);
+int qState_ListFree(struct _QState * qList);
+
+#define QHASH_LIVE(h,i) ((h)->Amp[i] != 0)
+
+// working state used by qEmul_exec. once most basis values are populated the
+// amplitudes move from the sparse backends into a dense array of 2^numQubits
+// entries indexed by Value, and back again when the state thins out
+
+#define QDENSE_MAX_QUBITS 26    // 2^26 amplitudes = 1GB
+#define QDENSE_ENTER 8          // go dense when at least 1/8 of the values are live
+#define QDENSE_LEAVE 32         // go sparse when fewer than 1/32 are live
+
+// a large sparse state is split into 2^ShardBits hash tables by the top
+// ShardBits qubits of Value, so that threads can fill their own shards of the
+// next step without locking. gates whose target is below the shard bits keep
+// every entry in its shard
+
+#define QSHARD_MIN_LIVE 4096    // smaller states stay in one table
+#define QSHARD_MAX_BITS 10
+
+// the sorted backend keeps the live entries as a run of increasing Key with
+// their amplitudes, which is the order of the exported list. a step fills it
+// by emitting every output pair into a buffer of its thread, then settling:
+// radix sort by Value, then add up equal values and drop the ones that cancel
+
+typedef struct _QEmit
+{
+  unsigned long * Key;
+  double complex * Amp;
+  unsigned long Num;
+  unsigned long Size;
+} QEmit;
+
+typedef struct _QStore
+{
+  int Dense;
+  int Sorted;
+  int numQubits;
+  int ShardBits;
+  int ShardShift;             // Value >> ShardShift gives the shard
+  QHash * Hash;               // sparse backend, 1 << ShardBits tables
+  double complex * Amp;       // dense backend, or the amplitudes of Key when sorted
+  unsigned long * Key;        // sorted backend
+  unsigned long Live;         // non-zero entries of Amp, or length of Key
+  QEmit * Emit;               // sorted backend being filled, one per thread
+  int numEmit;
+  int Totals;                 // Norm2 and AbsSum below are up to date
+  double Norm2;               // the qState_StoreCount2 measure
+  double AbsSum;              // sum of |re|+|im|
+} QStore;
+
+#define QSTORE_SHARD(s,v) (((v) >> (s)->ShardShift) & ((1UL << (s)->ShardBits) - 1))
+
+void qState_StoreInit(QStore * qStore, int numQubits, unsigned long hint, int dense);
+void qState_StoreInitShards(QStore * qStore, int numQubits, unsigned long hint, int shardBits);
+void qState_StoreInitSorted(QStore * qStore, int numQubits, unsigned long hint);
+void qState_StoreSettle(QStore * qStore);
+void qState_StoreFree(QStore * qStore);
+void qState_StoreAdd(QStore * qStore, unsigned long Value, double complex Count);
+int qState_StoreGet(QStore * qStore, unsigned long Value, double complex * Count);
+int qState_StoreTake(QStore * qStore, unsigned long Value, double complex * Count);
+void qState_StoreFilter(QStore * qStore, unsigned long mask, unsigned long match);
+int qState_StoreNext(QStore * qStore, unsigned long * pos, struct _QState * entry);
+unsigned long qState_StoreLive(QStore * qStore);
+int qState_StoreWantDense(int numQubits, unsigned long live);
+int qState_StoreWantShards(int numQubits, unsigned long live);
+void qState_StoreBalance(QStore * qStore);
+int qState_StoreMakeDense(QStore * qStore);
+void qState_StoreMakeHash(QStore * qStore);
+void qState_StoreMakeSorted(QStore * qStore);
+void qState_StoreFromList(QStore * qStore, int numQubits, struct _QState * qList);
+void qState_StoreToList(QStore * qStore, struct _QState ** qList);
+// the totals are kept in the store, the filter and the steps on a whole store
+// update or drop them. StoreAdd and StoreTake leave them alone, they only fill
+// or drain stores that are not measured in between
+double qState_StoreCount2(QStore * qStore);
+double qState_StoreAbsSum(QStore * qStore);
+unsigned long qState_StorePick(QStore * qStore, double chosen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif